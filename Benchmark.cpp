@@ -0,0 +1,414 @@
+// Benchmark-suite for the simulation hot-paths; built by the 'bench' target (headless, see Headless.cpp).
+// Each phase of the (old-method) update is timed seperately, from an identical snapshot every repetition,
+// over a few fixed scenes and particle-counts, and for every requested thread-count.
+#ifndef FLUIDSIM_HEADLESS
+#error "Benchmark.cpp requires FLUIDSIM_HEADLESS (build with 'make bench')"
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+#include "Simulation.hpp"
+#include "Threading.hpp" // ThreadManager
+
+
+// normally defined in Main.cpp
+float timestepRatio{1.0f};
+float timestepMultiplier{1.0f};
+const int framerateCap{0};
+
+// results of the timed loops are stored here, so they (and the loops) can't be optimized out
+static volatile float benchmarkSink{0.0f};
+
+
+class Benchmark
+{
+    public:
+    enum class Scene { uniform, pile, turbulent, periodic };
+    static constexpr const char* SceneName(const Scene scene) {
+        switch (scene) {
+            case Scene::uniform:   return "uniform";
+            case Scene::pile:      return "pile";
+            case Scene::turbulent: return "turbulent";
+            case Scene::periodic:  return "periodic";
+        }
+        return "?";
+    }
+
+    struct Result {
+        Scene scene;
+        std::size_t particlecount;
+        unsigned int threadcount;
+        std::string phase;
+        double medianNs;   // per repetition
+        double perItemNs;  // per particle (or per pair, for CalcLocalForce)
+    };
+
+    private:
+    // everything needed to rewind a Simulation to the same state (the cells' coordinates never change, only their state-arrays)
+    struct Snapshot {
+        ParticleState particles;
+        std::vector<float> density, momentumX, momentumY, diffusionX, diffusionY;
+    };
+
+    int repetitions {20};
+    int warmupSteps {300};
+    std::vector<unsigned int> threadcounts;
+    std::vector<int> layouts {32, 64, 96}; // columns (=rows)
+    std::vector<Scene> scenes {Scene::uniform, Scene::pile, Scene::turbulent, Scene::periodic};
+    std::vector<Result> results;
+
+    static Snapshot Save(const Simulation& simulation) {
+        const DiffusionField& field = simulation.diffusionField;
+        return {simulation.fluid.particles, field.density, field.momentumX, field.momentumY, field.diffusionX, field.diffusionY};
+    }
+    static void Restore(Simulation& simulation, const Snapshot& snapshot) {
+        simulation.fluid.particles = snapshot.particles;
+        DiffusionField& field = simulation.diffusionField;
+        field.density    = snapshot.density;
+        field.momentumX  = snapshot.momentumX;  field.momentumY  = snapshot.momentumY;
+        field.diffusionX = snapshot.diffusionX; field.diffusionY = snapshot.diffusionY;
+        simulation.RebuildCellIndex();
+    }
+
+    static std::unique_ptr<Simulation> CreateScene(const Scene scene, const int layout, const int warmupSteps);
+    // median over repetitions; 'prepare' is untimed and runs before every repetition
+    double Measure(const std::function<void()>& prepare, const std::function<void()>& body) const;
+    void RunPhases(Simulation& simulation, const Scene scene);
+    // with a uniform density, the wrapping boundaries should leave no gradient anywhere (including at the far edges)
+    static bool CheckBoundaryGradients();
+
+    public:
+    bool ParseArgs(int argc, char** argv);
+    void Run();
+    void PrintResults() const;
+    bool WriteResults(const std::string& filename) const;
+    std::string outputFile {};
+};
+
+
+std::unique_ptr<Simulation> Benchmark::CreateScene(const Scene scene, const int layout, const int warmupSteps)
+{
+    auto simulation = std::make_unique<Simulation>();
+    if (!simulation->Initialize(layout, layout)) { return nullptr; }
+
+    // warmup is deterministic, so every thread-count starts from the same state
+    simulation->SetDeterministic(true, 0);
+    switch (scene)
+    {
+        case Scene::uniform: break; // freshly spawned grid
+        case Scene::turbulent:
+            simulation->ToggleTurbulence();
+        [[fallthrough]];
+        case Scene::pile:
+            simulation->hasGravity = true;
+            for (int step{0}; step < warmupSteps; ++step) { simulation->Update(); }
+        break;
+        case Scene::periodic: // bulk-flow without walls; wraps around, so it settles into a steady-state
+            simulation->SetBoundary(DiffusionField::Boundary::Periodic);
+            simulation->hasXGravity = true;
+            for (int step{0}; step < warmupSteps; ++step) { simulation->Update(); }
+        break;
+    }
+    simulation->SetDeterministic(false);
+    return simulation;
+}
+
+
+double Benchmark::Measure(const std::function<void()>& prepare, const std::function<void()>& body) const
+{
+    std::vector<double> samples;
+    samples.reserve(repetitions);
+    for (int rep{0}; rep < repetitions; ++rep)
+    {
+        prepare();
+        const auto start = std::chrono::steady_clock::now();
+        body();
+        const auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size()/2];
+}
+
+
+// mirrors the phases of Simulation::Update_OldMethod
+void Benchmark::RunPhases(Simulation& simulation, const Scene scene)
+{
+    const Snapshot snapshot = Save(simulation);
+    const std::size_t particlecount = snapshot.particles.size();
+    const unsigned int threadcount = simulation.threadPool.Size();
+    ThreadPool& pool = simulation.threadPool;
+
+    const std::size_t slicecount = pool.Size() * 4;
+    const std::size_t grainsize = std::max<std::size_t>((particlecount + slicecount - 1) / slicecount, 1);
+
+    const auto Record = [&](const std::string& phase, const double ns, const double items) {
+        results.push_back({scene, particlecount, threadcount, phase, ns, ns / items});
+    };
+    const auto Rewind = [&]() { Restore(simulation, snapshot); };
+    const auto UpdatePositions = [&]() {
+        pool.ParallelFor(particlecount, grainsize, [&](const std::size_t begin, const std::size_t end) {
+            simulation.fluid.UpdatePositions(begin, end, simulation.hasGravity, simulation.hasXGravity);
+        });
+    };
+    const auto FindTransitions = [&]() { simulation.DetectTransitions(); };
+    const auto SortTransitions = [&]() { simulation.transitionBuckets.Sort(pool, simulation.diffusionField.cells.size()); };
+    const auto HandleTransitions = [&]() { simulation.HandleTransitionBuckets(); };
+
+    Record("UpdatePositions", Measure(Rewind, UpdatePositions), particlecount);
+    Record("FindCellTransitions", Measure([&]{ Rewind(); UpdatePositions(); }, FindTransitions), particlecount);
+    Record("TransitionBuckets::Sort", Measure([&]{ Rewind(); UpdatePositions(); FindTransitions(); }, SortTransitions), particlecount);
+    Record("HandleTransitions", Measure([&]{ Rewind(); UpdatePositions(); FindTransitions(); SortTransitions(); }, HandleTransitions), particlecount);
+    Record("UpdateParticles", Measure(Rewind, [&]{ simulation.UpdateParticles(); }), particlecount);
+    // the reduction-step of UpdateParticles; a single shared buffer, so this should stay flat (or drop) as threads are added
+    Record("ApplyVelocityBuffer (reduction)", Measure([&]{ Rewind(); simulation.velocityBuffer.resize(particlecount); }, [&]{ simulation.ApplyVelocityBuffer(); }), particlecount);
+    Record("Update (total)", Measure(Rewind, [&]{ simulation.Update_OldMethod(); }), particlecount);
+
+    // CalcLocalForce alone (single-threaded); every pair that UpdateParticles would evaluate
+    if (threadcount == 1)
+    {
+        Rewind();
+        std::size_t paircount{0};
+        for (const unsigned int cellID: simulation.cellIndex.OccupiedCells()) {
+            const std::size_t count = simulation.cellIndex.Count(cellID);
+            paircount += (count * (count-1)) / 2;
+            for (const std::span<const unsigned int> adjacent: simulation.QueryNeighbors(cellID)) { paircount += count * adjacent.size(); }
+        }
+
+        sf::Vector2f sink{0.f, 0.f};
+        const auto EvaluatePairs = [&]() {
+            const ParticleState& particles = simulation.fluid.particles;
+            const float fdensity = simulation.fluid.fdensity;
+            for (const unsigned int cellID: simulation.cellIndex.OccupiedCells())
+            {
+                const std::span<const unsigned int> particleset = simulation.cellIndex[cellID];
+                for (auto top{particleset.begin()}; top != particleset.end(); ++top) {
+                    for (auto bottom{top+1}; bottom != particleset.end(); ++bottom) {
+                        sink += Fluid::CalcLocalForce(particles, *top, *bottom, fdensity);
+                    }
+                }
+                for (const std::span<const unsigned int> adjacent: simulation.QueryNeighbors(cellID)) {
+                    for (const unsigned int lh: particleset) {
+                        for (const unsigned int rh: adjacent) { sink += Fluid::CalcLocalForce(particles, lh, rh, fdensity); }
+                    }
+                }
+            }
+        };
+        Record("CalcLocalForce (per pair)", Measure([]{}, EvaluatePairs), std::max<std::size_t>(paircount, 1));
+        
+        // same pairs through the batched kernel (gathering and scattering included)
+        VelocityBuffer forces; forces.resize(simulation.fluid.particles.size());
+        PairBlock block;
+        const auto EvaluateKernel = [&]() {
+            for (const unsigned int cellID: simulation.cellIndex.OccupiedCells()) {
+                const std::span<const unsigned int> particleset = simulation.cellIndex[cellID];
+                simulation.LocalDiffusion(particleset, forces, block);
+                simulation.NonLocalDiffusion(particleset, simulation.QueryNeighbors(cellID), forces, block);
+            }
+        };
+        Record("AccumulatePairForces (per pair)", Measure([]{}, EvaluateKernel), std::max<std::size_t>(paircount, 1));
+        Fluid::useForceTable = true;
+        Record("AccumulatePairForces+table", Measure([]{}, EvaluateKernel), std::max<std::size_t>(paircount, 1));
+        Fluid::useForceTable = false;
+        sink += sf::Vector2f{forces.dvx[0], forces.dvy[0]};
+        benchmarkSink = sink.x + sink.y;
+    }
+
+    // density-gradient field at longer diffusion-ranges, through each path (per cell); for calibrating DiffusionField::PreferFFT
+    DiffusionField& field = simulation.diffusionField;
+    const double cellcount = double(field.cells.size());
+    const float scale = timestepRatio * simulation.fluid.fdensity;
+    for (const int requested: {DIFFUSION_RADIUS, 16, 32, 64})
+    {
+        field.SetDiffusionRange(requested);
+        const int range = field.GetDiffusionRange(); // limited by the grid-size
+        if (range != requested) { continue; } // same as a smaller range
+        for (const auto method: {DiffusionField::DiffusionMethod::Direct, DiffusionField::DiffusionMethod::FFT}) {
+            field.SetDiffusionMethod(method);
+            const std::string name = (method == DiffusionField::DiffusionMethod::FFT)? "fft" : "direct";
+            Record("CalcDiffusionField (range " + std::to_string(range) + ", " + name + ")",
+                   Measure([]{}, [&]{ field.CalcDiffusionField(pool, scale); }), cellcount);
+        }
+    }
+    field.SetDiffusionMethod(DiffusionField::DiffusionMethod::Auto);
+    field.SetDiffusionRange(DIFFUSION_RADIUS);
+    return;
+}
+
+
+bool Benchmark::CheckBoundaryGradients()
+{
+    using Boundary = DiffusionField::Boundary;
+    using Method = DiffusionField::DiffusionMethod;
+    DiffusionField field{};
+    if (!field.Initialize()) { return false; }
+    ThreadPool pool{1};
+    
+    bool passed {true};
+    std::cout << "\nmax diffusion-force at the edges, with uniform density:\n";
+    for (const Boundary boundary: {Boundary::Reflective, Boundary::Periodic}) {
+        field.SetBoundary(boundary);
+        for (const int requested: {DIFFUSION_RADIUS, diffusionrange_limit}) {
+            field.SetDiffusionRange(requested);
+            const int range = field.GetDiffusionRange(); // limited by the grid-size
+            for (const Method method: {Method::Direct, Method::FFT})
+            {
+                field.SetDiffusionMethod(method);
+                // the empty column/row past the domain isn't part of the field; only the real edges are checked
+                const auto UUID = [](const unsigned int IX, const unsigned int IY) { return IX*Cell::arraySizeY + IY; };
+                std::ranges::fill(field.density, 0.0f);
+                for (unsigned int IX{0}; IX < Cell::maxIX; ++IX) {
+                    for (unsigned int IY{0}; IY < Cell::maxIY; ++IY) { field.density[UUID(IX, IY)] = 1.0f; }
+                }
+                field.CalcDiffusionField(pool, 1.0f);
+                
+                float maxForce {0.0f};
+                for (const unsigned int edgeX: {0u, Cell::maxIX-1}) {
+                    for (unsigned int IY{0}; IY < Cell::maxIY; ++IY) { maxForce = std::max(maxForce, std::abs(field.diffusionX[UUID(edgeX, IY)])); }
+                }
+                for (const unsigned int edgeY: {0u, Cell::maxIY-1}) {
+                    for (unsigned int IX{0}; IX < Cell::maxIX; ++IX) { maxForce = std::max(maxForce, std::abs(field.diffusionY[UUID(IX, edgeY)])); }
+                }
+                const bool isZero = (maxForce < 1e-3f); // relative to a density of 1; float rounding over the kernel
+                passed = passed && isZero;
+                std::cout << "  " << ((boundary == Boundary::Reflective)? "reflective" : "periodic  ")
+                          << " range " << std::setw(2) << range << ((method == Method::FFT)? " fft:    " : " direct: ")
+                          << maxForce << (isZero? "" : "  <- FAILED") << '\n';
+            }
+        }
+    }
+    return passed;
+}
+
+
+bool Benchmark::ParseArgs(int argc, char** argv)
+{
+    const auto ParseList = [](const std::string& list) {
+        std::vector<int> values;
+        std::size_t start{0};
+        while (start < list.size()) {
+            std::size_t end = list.find(',', start);
+            if (end == std::string::npos) end = list.size();
+            values.push_back(std::stoi(list.substr(start, end-start)));
+            start = end + 1;
+        }
+        return values;
+    };
+
+    for (int C{1}; C < argc; ++C)
+    {
+        const std::string arg {argv[C]};
+        const std::size_t split = arg.find('=');
+        const std::string key   = arg.substr(0, split);
+        const std::string value = (split == std::string::npos)? "" : arg.substr(split+1);
+        try {
+            if      (key == "--reps")    { repetitions = std::max(std::stoi(value), 1); }
+            else if (key == "--warmup")  { warmupSteps = std::stoi(value); }
+            else if (key == "--layouts") { layouts = ParseList(value); }
+            else if (key == "--threads") {
+                threadcounts.clear();
+                for (const int count: ParseList(value)) { threadcounts.push_back(std::max(count, 1)); }
+            }
+            else if (key == "--scenes") {
+                scenes.clear();
+                if (value.contains("uniform"))   scenes.push_back(Scene::uniform);
+                if (value.contains("pile"))      scenes.push_back(Scene::pile);
+                if (value.contains("turbulent")) scenes.push_back(Scene::turbulent);
+                if (value.contains("periodic"))  scenes.push_back(Scene::periodic);
+            }
+            else if (key == "--output")  { outputFile = value; }
+            else if (key == "--accuracy") { PrintForceTableAccuracy(); }
+            else if (key == "--check-boundaries") { if (!CheckBoundaryGradients()) return false; }
+            else if ((key == "--width") || (key == "--height")) { config.Set(key.substr(2), value); } // domain for every layout
+            else {
+                std::cerr << "unrecognized argument: " << arg << '\n'
+                    << "usage: bench [--reps=N] [--warmup=N] [--layouts=32,64,96] [--threads=1,2,4] [--width=N --height=N]"
+                    << " [--scenes=uniform,pile,turbulent,periodic] [--output=results.csv] [--accuracy] [--check-boundaries]\n";
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << "invalid value for " << key << ": '" << value << "'\n";
+            return false;
+        }
+    }
+
+    // default: powers of two up to hardware_concurrency (and hardware_concurrency itself)
+    if (threadcounts.empty()) {
+        const unsigned int hardware = ThreadManager{}.GetThreadCount();
+        for (unsigned int count{1}; count < hardware; count *= 2) { threadcounts.push_back(count); }
+        threadcounts.push_back(hardware);
+    }
+    return true;
+}
+
+
+void Benchmark::Run()
+{
+    for (const Scene scene: scenes) {
+        for (const int layout: layouts)
+        {
+            std::unique_ptr<Simulation> simulation = CreateScene(scene, layout, warmupSteps);
+            if (!simulation) { std::cerr << "skipping layout: " << layout << '\n'; continue; }
+            for (const unsigned int threadcount: threadcounts) {
+                simulation->threadPool.Resize(threadcount);
+                std::cerr << SceneName(scene) << " | " << layout*layout << " particles | " << threadcount << " threads\n";
+                RunPhases(*simulation, scene);
+            }
+        }
+    }
+    return;
+}
+
+
+void Benchmark::PrintResults() const
+{
+    std::cout << '\n' << std::left
+        << std::setw(11) << "scene" << std::setw(11) << "particles" << std::setw(9) << "threads"
+        << std::setw(34) << "phase" << std::setw(14) << "median(us)" << std::setw(12) << "ns/item" << "speedup\n";
+
+    for (const Result& result: results)
+    {
+        // speedup relative to the single-thread (or lowest thread-count) result of the same phase
+        const auto baseline = std::find_if(results.begin(), results.end(), [&](const Result& other) {
+            return (other.scene == result.scene) && (other.particlecount == result.particlecount) && (other.phase == result.phase);
+        });
+        std::cout << std::setw(11) << SceneName(result.scene) << std::setw(11) << result.particlecount
+            << std::setw(9) << result.threadcount << std::setw(34) << result.phase
+            << std::setw(14) << std::fixed << std::setprecision(1) << result.medianNs / 1000.0
+            << std::setw(12) << std::setprecision(2) << result.perItemNs
+            << std::setprecision(2) << baseline->medianNs / result.medianNs << "x\n";
+    }
+    return;
+}
+
+
+bool Benchmark::WriteResults(const std::string& filename) const
+{
+    std::ofstream file(filename);
+    if (!file) { std::cerr << "failed to open: " << filename << '\n'; return false; }
+    file << "scene,particles,threads,phase,median_ns,ns_per_item\n";
+    for (const Result& result: results) {
+        file << SceneName(result.scene) << ',' << result.particlecount << ',' << result.threadcount << ','
+             << result.phase << ',' << result.medianNs << ',' << result.perItemNs << '\n';
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv)
+{
+    Benchmark benchmark{};
+    if (!benchmark.ParseArgs(argc, argv)) { return 1; }
+    benchmark.Run();
+    benchmark.PrintResults();
+    if (!benchmark.outputFile.empty() && !benchmark.WriteResults(benchmark.outputFile)) { return 2; }
+    return 0;
+}
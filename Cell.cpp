@@ -55,38 +55,17 @@ int CalcBaseNCount(int radial_distance) {
 }
 
 
-// TODO: write constexpr (template) version of this
+// copies a ring out of the compile-time stencil (the hot-paths use the Stencil directly)
 CoordlistRel GetNeighbors(const int radial_distance) // relative verison
 {
-    switch (radial_distance) {
-        case 0: return CoordlistRel {};
-        case 1: return CoordlistRel { {1, 0}, {-1, 0}, {0, 1}, {0, -1}, };
-        case 2: return CoordlistRel {
-            {2, 0}, {-2, 0}, { 0, 2}, { 0, -2}, 
-            {1, 1}, {1, -1}, {-1, 1}, {-1, -1},
-        };
-        case 3: return CoordlistRel {
-            {3, 0}, {-3, 0}, { 0, 3}, { 0, -3}, 
-            {2, 1}, {2, -1}, {-2, 1}, {-2, -1}, 
-            {1, 2}, {1, -2}, {-1, 2}, {-1, -2},
-        };
-        case 4: return CoordlistRel {
-            {4, 0}, {-4, 0}, { 0, 4}, { 0, -4},
-            {3, 1}, {3, -1}, {-3, 1}, {-3, -1}, 
-            {2, 2}, {2, -2}, {-2, 2}, {-2, -2}, 
-            {1, 3}, {1, -3}, {-1, 3}, {-1, -3},
-        };
-        case 5: return CoordlistRel {
-            {5, 0}, {-5, 0}, { 0, 5}, { 0, -5},
-            {4, 1}, {4, -1}, {-4, 1}, {-4, -1}, 
-            {3, 2}, {3, -2}, {-3, 2}, {-3, -2}, 
-            {2, 3}, {2, -3}, {-2, 3}, {-2, -3}, 
-            {1, 4}, {1, -4}, {-1, 4}, {-1, -4},
-        };
-        default: 
-            assert(false && "Neighbor-coords not defined for radial distance: " && radial_distance);
-            return CoordlistRel {};
+    if (radial_distance <= 0) { return CoordlistRel {}; }
+    assert((radial_distance <= radialdist_limit) && "Neighbor-coords not generated for radial distance");
+    CoordlistRel coords{};
+    coords.reserve(4*radial_distance);
+    for (const StencilOffset& offset: StencilRing(Stencil<radialdist_limit>, radial_distance)) {
+        coords.push_back({offset.dx, offset.dy});
     }
+    return coords;
 };
 
 
@@ -95,15 +74,14 @@ CoordlistRel GetNeighbors(const int radial_distance) // relative verison
 CoordlistAbs GetNeighbors(const int radial_distance, const int IX, const int IY)
 {
     CoordlistAbs absoluteCoords{};
-    for (const auto& [dx, dy] : GetNeighbors(radial_distance)) {
-        const int resultX = IX+dx;
-        const int resultY = IY+dy;
+    if (radial_distance <= 0) { return absoluteCoords; }
+    assert((radial_distance <= radialdist_limit) && "Neighbor-coords not generated for radial distance");
+    for (const StencilOffset& offset: StencilRing(Stencil<radialdist_limit>, radial_distance)) {
+        const int resultX = IX+offset.dx;
+        const int resultY = IY+offset.dy;
         // TODO: return something to handle the edges (out-of-bounds)
-        if((resultX < 0) || (resultY < 0)) continue;
-        else if((resultX > int(Cell::maxIX)) || (resultY > int(Cell::maxIY))) continue;
-        else {
-            absoluteCoords.push_back({resultX, resultY});
-        }
+        if (!Cell::isValidIndex(resultX, resultY)) continue;
+        absoluteCoords.push_back({resultX, resultY});
     }
     return absoluteCoords;
 }
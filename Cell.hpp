@@ -2,10 +2,16 @@
 #define FLUIDSIM_CELL_INCLUDED
 
 #include <vector>
+#include <array>
+#include <span>
 #include <tuple>  //std::pair
 #include <ranges> //LocalCells
+#include <algorithm> // clamp
+#include <cmath> // abs
 
-#include <SFML/Graphics/RectangleShape.hpp>
+#include <SFML/System/Vector2.hpp>
+#include <SFML/Graphics/Rect.hpp>
+#include <SFML/Graphics/Color.hpp>
 
 #include "Globals.hpp"
 
@@ -60,19 +66,11 @@ struct LocalCells<0> {
 
 
 // TODO: make a version with const(expr) indecies and IDs
-class Cell: public sf::RectangleShape {
+// only the cell's coordinates; the per-cell state (density, momentum, diffusionVec) lives in the DiffusionField,
+// as dense arrays indexed by UUID. nothing here is drawable; the shapes are generated when the grid is rendered
+class Cell {
     static constexpr float colorscaling {64.0}; // density required for all-white color;
     unsigned int IX, IY, UUID; // UUID is the array index of Cell
-    sf::Vector2f diffusionVec{0.0, 0.0}; // force calculated from the density of nearby cells
-    sf::Vector2f momentum{0.0, 0.0}; // stored velocity imparted by particles, distributed to local particles
-    float density{0.0};
-    
-    void Reset() {
-        diffusionVec = {0.f, 0.f};
-        momentum     = {0.f, 0.f};
-        density      =  0.f;
-    }
-    // IX, IY, UUID will be handled by Simulation::Reset()
     
     public:
     friend class DiffusionField;
@@ -81,41 +79,102 @@ class Cell: public sf::RectangleShape {
     
     // maybe better in Coord class??
     // if the field's dimensions are not evenly divisible by cell-size, we need an extra cell to cover the remainder
-    static constexpr unsigned int maxIX = (BOXWIDTH /SPATIAL_RESOLUTION + ((BOXWIDTH %SPATIAL_RESOLUTION)? 1:0));
-    static constexpr unsigned int maxIY = (BOXHEIGHT/SPATIAL_RESOLUTION + ((BOXHEIGHT%SPATIAL_RESOLUTION)? 1:0));
-    static constexpr unsigned int arraySizeX = maxIX+1;
-    static constexpr unsigned int arraySizeY = maxIY+1;
+    // (sized at runtime by SetGridSize; from SimulationConfig, during DiffusionField::Initialize)
+    static inline unsigned int maxIX = (BOXWIDTH /SPATIAL_RESOLUTION + ((BOXWIDTH %SPATIAL_RESOLUTION)? 1:0));
+    static inline unsigned int maxIY = (BOXHEIGHT/SPATIAL_RESOLUTION + ((BOXHEIGHT%SPATIAL_RESOLUTION)? 1:0));
+    static inline unsigned int arraySizeX = maxIX+1;
+    static inline unsigned int arraySizeY = maxIY+1;
     
+    static void SetGridSize(const unsigned int boxWidth, const unsigned int boxHeight) {
+        maxIX = (boxWidth /SPATIAL_RESOLUTION + ((boxWidth %SPATIAL_RESOLUTION)? 1:0));
+        maxIY = (boxHeight/SPATIAL_RESOLUTION + ((boxHeight%SPATIAL_RESOLUTION)? 1:0));
+        arraySizeX = maxIX+1;
+        arraySizeY = maxIY+1;
+    }
     
-    Cell()
-    : sf::RectangleShape(sf::Vector2f{SPATIAL_RESOLUTION, SPATIAL_RESOLUTION}),
-    IX{0}, IY{0}, UUID{0} 
-    { }
+    static bool isValidIndex(const int X, const int Y) {
+        return (X >= 0) && (Y >= 0) && (X <= int(maxIX)) && (Y <= int(maxIY));
+    }
     
-    Cell(const unsigned int X, const unsigned int Y, const unsigned int UUID) 
-    : sf::RectangleShape(sf::Vector2f{SPATIAL_RESOLUTION, SPATIAL_RESOLUTION}),
-    IX{X}, IY{Y}, UUID{UUID}
-    {
-        setFillColor(sf::Color::Transparent);
-        setOutlineColor(sf::Color(0xFFFFFF40));  // mostly-transparent white
-        setOutlineThickness(0.5);
-        setPosition(sf::Vector2f{float(X*SPATIAL_RESOLUTION), float(Y*SPATIAL_RESOLUTION)});
+    static constexpr float inverseResolution {1.0f / SPATIAL_RESOLUTION};
+    // UUID of the cell containing a position; UUIDs are column-major (IX*arraySizeY + IY), the order DiffusionField creates them in.
+    // clamped to the grid, since particles can sit slightly past the edges. no branches; so loops over it can vectorize
+    static unsigned int UUIDAt(const float x, const float y) {
+        const int IX = std::clamp(int(x * inverseResolution), 0, int(maxIX));
+        const int IY = std::clamp(int(y * inverseResolution), 0, int(maxIY));
+        return unsigned(IX*int(arraySizeY) + IY);
     }
     
-    void UpdateColor() {
+    
+    Cell(): IX{0}, IY{0}, UUID{0} { }
+    Cell(const unsigned int X, const unsigned int Y, const unsigned int UUID): IX{X}, IY{Y}, UUID{UUID} { }
+    
+    // top-left corner in the field (units/pixels)
+    sf::Vector2f Position() const { return sf::Vector2f{float(IX*SPATIAL_RESOLUTION), float(IY*SPATIAL_RESOLUTION)}; }
+    sf::FloatRect Bounds() const { return sf::FloatRect{Position(), sf::Vector2f{SPATIAL_RESOLUTION, SPATIAL_RESOLUTION}}; }
+    
+    // fill-color representing a cell's density (DiffusionField::Redraw writes these into the density-texture)
+    static sf::Color DensityColor(const float density) {
         if (density < 0) {  // painting negative-density areas red/magenta
             sf::Uint8 alpha = (std::abs(density) >= 127/colorscaling ? 255 : colorscaling*std::abs(density) + 127);
             sf::Uint8 colorchannel = (std::abs(density) >= colorscaling ? 255 : (127/colorscaling)*std::abs(density) + 127);
-            setFillColor(sf::Color(colorchannel, 0, colorchannel/2, alpha/1.5));
-            return; 
+            return sf::Color(colorchannel, 0, colorchannel/2, alpha/1.5);
         }
         sf::Uint8 alpha = (density >= 127/colorscaling ? 255 : colorscaling*density + 127); // avoiding overflows
         sf::Uint8 colorchannel = (density >= colorscaling ? 255 : (255/colorscaling)*density); // avoiding overflows
-        setFillColor(sf::Color(colorchannel, colorchannel, colorchannel, alpha));  // white
+        return sf::Color(colorchannel, colorchannel, colorchannel, alpha);  // white
     }
 };
 
 
+// STENCILS //
+// Relative offsets of every cell within a radial-distance (orthogonal) of RD, generated at compile-time
+// from LocalCells<>::BaseRelativeCoords (for any radius), and ordered by distance (closest ring first).
+// the grid's size is only known at runtime, so the offsets between cells are resolved by the DiffusionField
+// (into it's padded-grid, which needs no bounds-checks; see DiffusionField::BuildPadding)
+struct StencilOffset
+{
+    int dx, dy;
+    int radialdist;
+};
+
+// appends every ring up to (and including) RD; closest ring first
+template <int RD>
+consteval void AppendStencilRings(StencilOffset*& out)
+{
+    if constexpr (RD > 1) { AppendStencilRings<RD-1>(out); }
+    for (const auto& [firstcoord, secondcoord]: LocalCells<RD>::BaseRelativeCoords()) {
+        for (const auto& [dx, dy]: {firstcoord, secondcoord}) {
+            *out++ = StencilOffset{dx, dy, RD};
+            if (dy == 0) break;  // skip duplicates on either end
+        }
+    }
+}
+
+template <int RD>
+consteval std::array<StencilOffset, LocalCells<RD>::BasecountTotal()> MakeStencil()
+{
+    std::array<StencilOffset, LocalCells<RD>::BasecountTotal()> stencil{};
+    StencilOffset* out = stencil.data();
+    if constexpr (RD > 0) { AppendStencilRings<RD>(out); }
+    return stencil;
+}
+
+template <int RD>
+inline constexpr auto Stencil = MakeStencil<RD>();
+
+// offsets at exactly radial-distance 'd' within any stencil (of radius >= d); rings are 4*d cells each
+constexpr std::span<const StencilOffset> StencilRing(const std::span<const StencilOffset> stencil, const int d) {
+    return stencil.subspan(2*d*(d-1), 4*d);
+}
+
+static_assert(Stencil<2>.size() == 12);
+static_assert((Stencil<2>[0].radialdist == 1) && (Stencil<2>[4].radialdist == 2));
+static_assert(StencilRing(Stencil<3>, 3).front().radialdist == 3);
+
+// END STENCILS //
+
+
 // TODO: use these to replace 'Coordlist-Rel/Abs'
 struct CoordBase_T
 {
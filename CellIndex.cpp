@@ -0,0 +1,30 @@
+#include "CellIndex.hpp"
+
+#include <cassert>
+
+
+void CellIndex::Rebuild(const std::vector<unsigned int>& cellIDs, const std::size_t cellcount)
+{
+    // counting
+    offsets.assign(cellcount+1, 0);
+    for (const unsigned int cellID: cellIDs) {
+        assert((cellID < cellcount) && "particle's cellID is out-of-range");
+        ++offsets[cellID+1];
+    }
+
+    // prefix-sum (offsets[C] becomes the start of cell C); also collecting occupied cells
+    occupied.clear();
+    for (std::size_t C{0}; C < cellcount; ++C) {
+        if (offsets[C+1] > 0) occupied.push_back(C);
+        offsets[C+1] += offsets[C];
+    }
+
+    // scatter; iterating particles in order keeps each bucket sorted by UUID
+    cursor.assign(offsets.begin(), offsets.end()-1);
+    sorted.resize(cellIDs.size());
+    for (unsigned int ID{0}; ID < cellIDs.size(); ++ID) {
+        sorted[cursor[cellIDs[ID]]++] = ID;
+    }
+
+    return;
+}
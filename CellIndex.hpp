@@ -0,0 +1,35 @@
+#ifndef FLUIDSIM_CELLINDEX_HPP_INCLUDED
+#define FLUIDSIM_CELLINDEX_HPP_INCLUDED
+
+#include <vector>
+#include <span>
+#include <cstddef> // size_t
+
+
+// Flat 'cell-list' of particles, bucketed by cellID (counting-sort).
+// The particles of cell C are: sorted[offsets[C] .. offsets[C+1])
+// Rebuilt from the particles' cellIDs every step, in O(particles + cells), without any hashing.
+// Within each cell, particles are ordered by ascending UUID (the scatter is stable).
+class CellIndex
+{
+    std::vector<unsigned int> offsets;  // exclusive prefix-sum of per-cell counts (size: cellcount+1)
+    std::vector<unsigned int> sorted;   // particle UUIDs, bucketed by cellID
+    std::vector<unsigned int> occupied; // cellIDs containing at least one particle (ascending)
+    std::vector<unsigned int> cursor;   // scratch-space for the scatter (kept to avoid reallocating)
+
+    public:
+    void Rebuild(const std::vector<unsigned int>& cellIDs, const std::size_t cellcount);
+    void Clear() { offsets.clear(); sorted.clear(); occupied.clear(); }
+
+    std::span<const unsigned int> operator[](const std::size_t cellID) const {
+        return {sorted.data() + offsets[cellID], sorted.data() + offsets[cellID+1]};
+    }
+    std::size_t Count(const std::size_t cellID) const { return offsets[cellID+1] - offsets[cellID]; }
+    bool isEmpty(const std::size_t cellID) const { return (offsets[cellID+1] == offsets[cellID]); }
+
+    const std::vector<unsigned int>& OccupiedCells() const { return occupied; }
+    std::size_t CellCount() const { return (offsets.empty()? 0 : offsets.size()-1); }
+};
+
+
+#endif
@@ -0,0 +1,82 @@
+#include "Globals.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cctype> // isspace
+
+
+SimulationConfig config{};
+
+
+bool SimulationConfig::Set(const std::string& key, const std::string& value)
+{
+    if      (key == "columns") { columns   = std::stoi(value); }
+    else if (key == "rows")    { rows      = std::stoi(value); }
+    else if (key == "width")   { boxWidth  = std::stoi(value); }
+    else if (key == "height")  { boxHeight = std::stoi(value); }
+    else return false;
+    return true;
+}
+
+
+bool SimulationConfig::LoadFile(const std::string& filename)
+{
+    std::ifstream file(filename);
+    if (!file) { std::cerr << "failed to open config-file: " << filename << '\n'; return false; }
+
+    const auto Trim = [](std::string str) {
+        const auto isSpace = [](const unsigned char c) { return std::isspace(c); };
+        str.erase(str.begin(), std::find_if_not(str.begin(), str.end(), isSpace));
+        str.erase(std::find_if_not(str.rbegin(), str.rend(), isSpace).base(), str.end());
+        return str;
+    };
+
+    std::string line;
+    for (int lineNumber{1}; std::getline(file, line); ++lineNumber)
+    {
+        line = Trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+        const std::size_t split = line.find('=');
+        const std::string key   = Trim(line.substr(0, split));
+        const std::string value = (split == std::string::npos)? "" : Trim(line.substr(split+1));
+        try {
+            if (!Set(key, value)) {
+                std::cerr << filename << ':' << lineNumber << ": unrecognized key '" << key << "'\n";
+                return false;
+            }
+        } catch (const std::exception&) {
+            std::cerr << filename << ':' << lineNumber << ": invalid value for " << key << ": '" << value << "'\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+
+bool SimulationConfig::Validate() const
+{
+    // the periodic neighbor-stencils would otherwise wrap onto the same cells twice
+    // (the runtime diffusion-range is held to the same rule by DiffusionField::MaxDiffusionRange)
+    constexpr int minimumSize {int(SPATIAL_RESOLUTION) * (2*DIFFUSION_RADIUS + 1)};
+    if ((boxWidth < minimumSize) || (boxHeight < minimumSize)) {
+        std::cerr << "width/height must be at least " << minimumSize << " (2*DIFFUSION_RADIUS+1 cells)\n";
+        return false;
+    }
+    if ((columns <= 0) || (rows <= 0)) {
+        std::cerr << "columns and rows must be greater than 0\n";
+        return false;
+    }
+    if ((columns > boxWidth) || (rows > boxHeight)) { // particles are spaced at least one unit apart
+        std::cerr << "too many columns/rows for a " << boxWidth << 'x' << boxHeight << " domain\n";
+        return false;
+    }
+    return true;
+}
+
+
+void SimulationConfig::Print() const
+{
+    std::cout << "columns: " << columns << "  rows: " << rows << "  (" << columns*rows << " particles)\n";
+    std::cout << "width: " << boxWidth << "  height: " << boxHeight << '\n';
+}
@@ -1,7 +1,10 @@
 #include "Diffusion.hpp"
+#include "ThreadPool.hpp"
 
 #include <vector>
 #include <iostream>
+#include <cassert>
+#include <cmath> // lerp, log2
 
 
 void DiffusionField::PrintAllCells() const
@@ -11,20 +14,85 @@ void DiffusionField::PrintAllCells() const
         std::cout << "UUID: " << cell.UUID << " ";
         std::cout << "ix: " << cell.IX << " ";
         std::cout << "iy: " << cell.IY << " ";
-        const auto& [x, y] = cell.getPosition();
+        const auto& [x, y] = cell.Position();
         std::cout << "\n\tposition: " << x << ", " << y << '\n';
     }
 }
 
 
+#ifndef FLUIDSIM_HEADLESS
+sf::RectangleShape DiffusionField::CellShape(const Cell& cell)
+{
+    sf::RectangleShape shape{sf::Vector2f{SPATIAL_RESOLUTION, SPATIAL_RESOLUTION}};
+    shape.setFillColor(sf::Color::Transparent);
+    shape.setOutlineColor(sf::Color(0xFFFFFF40));  // mostly-transparent white
+    shape.setOutlineThickness(0.5);
+    shape.setPosition(cell.Position());
+    return shape;
+}
+
+// the cells are drawn into the outline_texture exactly once (with their transparent fill)
+bool DiffusionField::InitializeGridTextures()
+{
+    if (!cellgrid_texture.create(config.boxWidth, config.boxHeight))
+        return false;
+    if (!outline_texture.create(config.boxWidth, config.boxHeight))
+        return false;
+    if (!density_texture.create(Cell::arraySizeX, Cell::arraySizeY))
+        return false;
+    density_texture.setSmooth(false); // each cell should be a solid block
+    density_pixels.resize(Cell::arraySizeX * Cell::arraySizeY * 4, 0);
+    
+    outline_texture.clear(sf::Color::Transparent);
+    for (const Cell& cell: cells) { outline_texture.draw(CellShape(cell)); }
+    outline_texture.display();
+    return true;
+}
+
+
+void DiffusionField::Redraw() { Redraw(density); }
+
+
+void DiffusionField::Redraw(std::span<const float> densities)
+{
+    assert(densities.size() == cells.size());
+    for (const Cell& cell: cells) {
+        const sf::Color color = Cell::DensityColor(densities[cell.UUID]);
+        sf::Uint8* pixel = &density_pixels[(cell.IY*Cell::arraySizeX + cell.IX) * 4];
+        pixel[0] = color.r; pixel[1] = color.g; pixel[2] = color.b; pixel[3] = color.a;
+    }
+    UploadDensityPixels();
+}
+
+
+void DiffusionField::UploadDensityPixels()
+{
+    density_texture.update(density_pixels.data());
+    
+    sf::Sprite densitySprite {density_texture};
+    densitySprite.setScale(float(SPATIAL_RESOLUTION), float(SPATIAL_RESOLUTION));
+    
+    cellgrid_texture.clear(sf::Color::Transparent);
+    cellgrid_texture.draw(densitySprite);
+    cellgrid_texture.draw(sf::Sprite{outline_texture.getTexture()});
+    cellgrid_texture.display();
+}
+#endif
+
+
 // result is for only a single distance
 std::vector<Cell*> DiffusionField::GetCellNeighbors(const std::size_t UUID, const unsigned int radialdist) const
 {
     const Cell& cell = cells.at(UUID);
     std::vector<Cell*> reflist{};
-    const CoordlistAbs coords = GetNeighbors(radialdist, cell.IX, cell.IY);
-    for (const auto& [ix, iy]: coords) {
-        reflist.push_back(cellmatrix.at(ix).at(iy));
+    if (radialdist == 0) { return reflist; }
+    assert((int(radialdist) <= radialdist_limit) && "Neighbor-coords not generated for radial distance");
+    const int P = PaddedIndex(cell.IX, cell.IY);
+    for (const StencilOffset& offset: StencilRing(Stencil<radialdist_limit>, radialdist)) {
+        const unsigned int neighborID = paddedCells[P + offset.dx*paddedSizeY + offset.dy];
+        if (neighborID == GhostUUID()) continue;
+        const Cell& neighbor = cells[neighborID];
+        reflist.push_back(cellmatrix[neighbor.IX][neighbor.IY]);
     }
     return reflist;
 }
@@ -34,11 +102,12 @@ std::vector<Cell*> DiffusionField::GetCellNeighbors(const std::size_t UUID) cons
 {
     const Cell& cell = cells.at(UUID);
     std::vector<Cell*> reflist;
-    for (unsigned int radius{1}; radius<=DIFFUSION_RADIUS; ++radius) {
-        const CoordlistAbs coords = GetNeighbors(radius, cell.IX, cell.IY);
-        for (const auto& [ix, iy]: coords) {
-            reflist.push_back(cellmatrix.at(ix).at(iy));
-        }
+    const int P = PaddedIndex(cell.IX, cell.IY);
+    for (const int offset: paddedStencil) {
+        const unsigned int neighborID = paddedCells[P + offset];
+        if (neighborID == GhostUUID()) continue;
+        const Cell& neighbor = cells[neighborID];
+        reflist.push_back(cellmatrix[neighbor.IX][neighbor.IY]);
     }
     return reflist;
 }
@@ -52,51 +121,242 @@ std::vector<DoubleCoord> DiffusionField::GetAdjacentPlus(const std::size_t UUID)
     const int IY = baseCell.IY;
     
     std::vector<DoubleCoord> coords{};
-    for (unsigned int radius{DIFFUSION_RADIUS}; radius>0; --radius) {
-        for (const auto& [dx, dy] : GetNeighbors(radius)) {
+    coords.reserve(Stencil<DIFFUSION_RADIUS>.size());
+    for (int radius{DIFFUSION_RADIUS}; radius>0; --radius) {
+        for (const auto& [dx, dy, radialdist] : StencilRing(Stencil<DIFFUSION_RADIUS>, radius)) {
             const int resultX = IX+dx;
             const int resultY = IY+dy;
-            if ((resultX < 0) || (resultY < 0)) continue;
-            else if ((resultX > int(Cell::maxIX)) || (resultY > int(Cell::maxIY))) continue;
-            else {
-                coords.push_back({{resultX, resultY}, {dx, dy}});
-            }
+            if (!Cell::isValidIndex(resultX, resultY)) continue;
+            coords.push_back({{resultX, resultY}, {dx, dy}});
         }
     }
     return coords;
 }
 
-// TODO: repurpose this function to smooth out momentum between cells, instead of creating a diffusionforce
-// TODO: store the constexpr parts seperately
-// coordpairs, cellmatrix-indecies, orthodist, etc. will all be static for a given UUID
-sf::Vector2f DiffusionField::CalcDiffusionVec(const std::size_t UUID) const
+// maps an index along one axis (possibly into the ghost-cells) to the real index it refers to; -1 if none.
+// 'domain' is the number of cells actually covering the field; the array has one more (always-empty) cell past it.
+static int ResolveBoundary(const int index, const int domain, const int arraySize, const DiffusionField::Boundary boundary)
 {
-    const Cell& cell = cells.at(UUID);
-    const std::vector<DoubleCoord> coordpairs = GetAdjacentPlus(UUID);
-    sf::Vector2f forcevector {0.0f, 0.0f};
+    using Boundary = DiffusionField::Boundary;
+    if (boundary == Boundary::Periodic) { return ((index % domain) + domain) % domain; }
+    // the empty cell past the domain is mirrored as well; otherwise the far edges would behave like Boundary::None
+    if (boundary == Boundary::Reflective) {
+        if ((index >= 0) && (index < domain)) { return index; }
+        const int mirrored = (index < 0)? (-index - 1) : (2*domain - index - 1);
+        return std::clamp(mirrored, 0, domain-1);
+    }
+    if ((index >= 0) && (index < arraySize)) { return index; }
+    return -1;
+}
+
+std::vector<float> CreateDiffusionKernel(const int range)
+{
+    if (range == DIFFUSION_RADIUS) { return std::vector<float>(DIFFUSIONKERNEL.begin(), DIFFUSIONKERNEL.end()); }
+    std::vector<float> kernel(range+1, 0.0f);
+    if constexpr (DIFFUSION_RADIUS > 0) {
+        const float stretch = float(DIFFUSION_RADIUS) / float(range);
+        for (int k{1}; k <= range; ++k) {
+            const float distance = float(k) * stretch; // in cells of the original kernel
+            const int lower = std::min(int(distance), DIFFUSION_RADIUS);
+            const int upper = std::min(lower+1, DIFFUSION_RADIUS);
+            kernel[k] = std::lerp(DIFFUSIONSCALING[lower], DIFFUSIONSCALING[upper], distance - float(lower)) * stretch;
+        }
+    }
+    return kernel;
+}
+
+void DiffusionField::BuildPadding()
+{
+    padding = std::max(gridPadding, diffusionRange);
+    paddedSizeX = int(Cell::arraySizeX) + 2*padding;
+    paddedSizeY = int(Cell::arraySizeY) + 2*padding;
+    for (std::size_t index{0}; index < paddedStencil.size(); ++index) {
+        paddedStencil[index] = Stencil<DIFFUSION_RADIUS>[index].dx*paddedSizeY + Stencil<DIFFUSION_RADIUS>[index].dy;
+    }
     
-    for (const auto& [abs, rel]: coordpairs) {
-        const auto& [ix, iy] = abs;
-        const Cell* const neighbor = cellmatrix.at(ix).at(iy);
-        
-        // scaling neighbor's density by distance
-        // taking max of either axis so that diagonals are considered a distance of 1, instead of 2
-        const int  diagdist = std::max(std::abs(rel.first), std::abs(rel.second));
-        //const int orthodist = std::abs(rel.first) + std::abs(rel.second);
-        const float magnitude = (cell.density - neighbor->density) * DIFFUSIONSCALING[diagdist];
+    const std::size_t paddedCount = paddedSizeX*paddedSizeY;
+    paddedCells.assign(paddedCount, GhostUUID());
+    paddedSources.assign(paddedCount, GhostUUID());
+    paddedDensity.assign(paddedCount, 0.0f);
+    std::vector<float> paddedWeight(paddedCount, 1.0f); // zero for ghost-cells that the boundary excludes entirely
+    
+    for (int X{-padding}; X < int(Cell::arraySizeX)+padding; ++X) {
+        for (int Y{-padding}; Y < int(Cell::arraySizeY)+padding; ++Y)
+        {
+            const int P = PaddedIndex(X, Y);
+            const int sourceX = ResolveBoundary(X, Cell::maxIX, Cell::arraySizeX, boundary);
+            const int sourceY = ResolveBoundary(Y, Cell::maxIY, Cell::arraySizeY, boundary);
+            if ((sourceX < 0) || (sourceY < 0)) {
+                if (boundary == Boundary::None) { paddedWeight[P] = 0.0f; }
+                continue;
+            }
+            paddedSources[P] = cellmatrix[sourceX][sourceY]->UUID;
+            // particles are only ever 'reflected' by the walls, so the mirrored cells aren't neighbors
+            const bool isReal = Cell::isValidIndex(X, Y);
+            if (boundary == Boundary::Periodic) { paddedCells[P] = paddedSources[P]; }
+            else if (isReal) { paddedCells[P] = cellmatrix[X][Y]->UUID; }
+        }
+    }
+    
+    rangeKernel = CreateDiffusionKernel(diffusionRange);
+    weightGradientX.assign(cells.size(), 0.0f);
+    weightGradientY.assign(cells.size(), 0.0f);
+    for (const Cell& cell: cells) {
+        const int P = PaddedIndex(cell.IX, cell.IY);
+        for (int k{1}; k <= diffusionRange; ++k) {
+            weightGradientX[cell.UUID] += rangeKernel[k] * (paddedWeight[P + k*paddedSizeY] - paddedWeight[P - k*paddedSizeY]);
+            weightGradientY[cell.UUID] += rangeKernel[k] * (paddedWeight[P + k] - paddedWeight[P - k]);
+        }
+    }
+    PrepareDiffusionKernels();
+    SyncPadding();
+}
+
+void DiffusionField::SyncPadding()
+{
+    for (std::size_t P{0}; P < paddedDensity.size(); ++P) {
+        const unsigned int source = paddedSources[P];
+        paddedDensity[P] = ((source == GhostUUID())? 0.0f : density[source]);
+    }
+}
+
+void DiffusionField::SetDiffusionRange(const int range)
+{
+    diffusionRange = std::clamp(range, 1, MaxDiffusionRange());
+    BuildPadding();
+}
+
+// estimated in units of one tap of the direct convolution (per cell); the direct loops vectorize, the butterflies mostly don't.
+// measured with the 'bench' target (the 'CalcDiffusionField' phases), on grids from 50 to 200 cells wide;
+// the FFT only wins with both a long range and long lines (range 64 past ~100 cells)
+bool DiffusionField::PreferFFT(const int range, const int lineLength)
+{
+    constexpr double butterflyCost {4.0}; // relative to a direct tap
+    const double size = double(FFTPlan::NextPowerOfTwo(lineLength + 2*range));
+    const double directCost = double(range) * double(lineLength);
+    // forward and inverse transforms (plus the spectrum-multiply), shared by two lines
+    const double fftCost = butterflyCost * (size * std::log2(size) + size) / 2.0;
+    return (fftCost < directCost);
+}
+
+void DiffusionField::PrepareDiffusionKernels()
+{
+    const int range = diffusionRange;
+    const bool isForced = (diffusionMethod != DiffusionMethod::Auto);
+    useFFTX = isForced? (diffusionMethod == DiffusionMethod::FFT) : PreferFFT(range, Cell::arraySizeX);
+    useFFTY = isForced? (diffusionMethod == DiffusionMethod::FFT) : PreferFFT(range, Cell::arraySizeY);
+    if (!useFFTX && !useFFTY) { return; }
+    
+    // the whole (antisymmetric) kernel, over [-range, range]
+    std::vector<float> kernel(2*range + 1, 0.0f);
+    for (int k{1}; k <= range; ++k) {
+        kernel[range + k] =  rangeKernel[k];
+        kernel[range - k] = -rangeKernel[k];
+    }
+    // each line also reads 'range' ghost-cells on either side
+    if (useFFTX) { fftLinesX.Prepare(Cell::arraySizeX + 2*range, kernel, range); }
+    if (useFFTY) { fftLinesY.Prepare(Cell::arraySizeY + 2*range, kernel, range); }
+}
+
+// each neighbor 'k' cells away pushes with (density - neighborDensity) * weight * kernel[k], away from the neighbor.
+// summed over both sides of an axis, the cell's own density only leaves 'density * weightGradient';
+// and excluded ghost-cells (zero weight) always have zero density, so the neighbors' part doesn't need the weight at all.
+// what's left is a plain convolution of the padded-grid along each axis.
+// 'stride' is the distance between neighbors along the axis; every cell of the run reads at the same offsets, so each loop is a straight run
+template <typename Kernel>
+static void ConvolveRun(const Kernel& kernel, const float* center, const std::ptrdiff_t stride,
+                        const float* gradient, float* force, const std::size_t count, const float scale)
+{
+    for (std::size_t index{0}; index < count; ++index) { force[index] = center[index] * gradient[index]; }
+    for (std::size_t k{1}; k < kernel.size(); ++k)
+    {
+        const float scaling = kernel[k];
+        const float* before = center - std::ptrdiff_t(k)*stride;
+        const float* after  = center + std::ptrdiff_t(k)*stride;
+        for (std::size_t index{0}; index < count; ++index) { force[index] += (before[index] - after[index]) * scaling; }
+    }
+    for (std::size_t index{0}; index < count; ++index) { force[index] *= scale; }
+}
+
+// the padded-columns are contiguous; along X, the neighbors are whole columns away (still contiguous over IY)
+void DiffusionField::CalcDiffusionColumn(const unsigned int IX, const float scale, const bool alongX, const bool alongY)
+{
+    const std::size_t rows = Cell::arraySizeY;
+    const std::size_t first = IX*rows; // UUID of (IX, 0)
+    const float* column = paddedDensity.data() + PaddedIndex(IX, 0);
+    const auto Convolve = [&](const auto& kernel) {
+        if (alongX) { ConvolveRun(kernel, column, paddedSizeY, &weightGradientX[first], &diffusionX[first], rows, scale); }
+        if (alongY) { ConvolveRun(kernel, column, 1, &weightGradientY[first], &diffusionY[first], rows, scale); }
+    };
+    // the default range gets the compile-time kernel (constant trip-count).
+    // the grid-size isn't specialized; compile-time column-sizes for the default grid (fully-unrolled runs) measured slower
+    // (~14 vs ~11 ns/cell, 'bench' CalcDiffusionField phase), since the runs are already contiguous and vectorized
+    if (diffusionRange == DIFFUSION_RADIUS) { Convolve(DIFFUSIONKERNEL); }
+    else { Convolve(rangeKernel); }
+}
+
+// same terms as ConvolveRun, but the convolution (of the neighbors' densities) goes through the FFT.
+// each line is gathered from the padded-grid along with the 'range' ghost-cells on either side of it
+void DiffusionField::CalcDiffusionLinesFFT(const unsigned int firstPair, const unsigned int lastPair, const float scale, const bool alongX)
+{
+    const FFTConvolution& convolution = alongX? fftLinesX : fftLinesY;
+    const unsigned int linecount = alongX? Cell::arraySizeY : Cell::arraySizeX;
+    const int length = alongX? Cell::arraySizeX : Cell::arraySizeY;
+    const int stride = alongX? paddedSizeY : 1; // between neighbors along the line, in the padded-grid
+    const int range = diffusionRange;
+    const std::vector<float>& gradient = alongX? weightGradientX : weightGradientY;
+    std::vector<float>& force = alongX? diffusionX : diffusionY;
+    // UUID of the cell at 'index' along 'line'
+    const auto CellAt = [alongX](const unsigned int line, const int index) {
+        return alongX? (index*Cell::arraySizeY + line) : (line*Cell::arraySizeY + index);
+    };
+    
+    thread_local std::vector<std::complex<float>> buffer;
+    buffer.resize(convolution.Size());
+    for (unsigned int pair{firstPair}; pair < lastPair; ++pair)
+    {
+        const unsigned int line = 2*pair;
+        const bool hasSecond = ((line+1) < linecount);
+        const float* first  = paddedDensity.data() + (alongX? PaddedIndex(-range, line)   : PaddedIndex(line, -range));
+        const float* second = paddedDensity.data() + (alongX? PaddedIndex(-range, line+1) : PaddedIndex(line+1, -range));
+        std::ranges::fill(buffer, std::complex<float>{0.0f, 0.0f});
+        for (int index{0}; index < length + 2*range; ++index) {
+            buffer[index] = {first[index*stride], (hasSecond? second[index*stride] : 0.0f)};
+        }
         
-        // we need to find the directional components of the vector (angle);
-        const int orthodist_sum {std::abs(rel.first) + std::abs(rel.second)};
-        const std::pair<float, float> angleComponents { 
-            float(rel.first /orthodist_sum), 
-            float(rel.second/orthodist_sum), 
-        };
+        convolution.Convolve(buffer);
         
-        forcevector += sf::Vector2f { 
-            float(magnitude*angleComponents.first),
-            float(magnitude*angleComponents.second),
-        };
+        for (int index{0}; index < length; ++index) {
+            const unsigned int UUID = CellAt(line, index);
+            force[UUID] = (density[UUID] * gradient[UUID] + buffer[index + range].real()) * scale;
+        }
+        if (!hasSecond) continue;
+        for (int index{0}; index < length; ++index) {
+            const unsigned int UUID = CellAt(line+1, index);
+            force[UUID] = (density[UUID] * gradient[UUID] + buffer[index + range].imag()) * scale;
+        }
+    }
+}
+
+// TODO: repurpose this to smooth out momentum between cells, instead of creating a diffusionforce
+void DiffusionField::CalcDiffusionField(ThreadPool& pool, const float scale)
+{
+    SyncPadding();
+    const bool directX {!useFFTX}, directY {!useFFTY};
+    if (directX || directY) {
+        pool.ParallelFor(Cell::arraySizeX, [this, scale, directX, directY](const std::size_t begin, const std::size_t end) {
+            for (std::size_t IX{begin}; IX < end; ++IX) { CalcDiffusionColumn(IX, scale, directX, directY); }
+        });
+    }
+    // lines are split by pairs (one transform each)
+    if (useFFTX) {
+        pool.ParallelFor((Cell::arraySizeY+1)/2, [this, scale](const std::size_t begin, const std::size_t end) {
+            CalcDiffusionLinesFFT(begin, end, scale, true);
+        });
+    }
+    if (useFFTY) {
+        pool.ParallelFor((Cell::arraySizeX+1)/2, [this, scale](const std::size_t begin, const std::size_t end) {
+            CalcDiffusionLinesFFT(begin, end, scale, false);
+        });
     }
-    
-    return forcevector;
 }
@@ -2,6 +2,9 @@
 #define FLUIDSIM_DIFFUSION_HPP_INCLUDED
 
 #include <array>
+#include <algorithm> // max, fill
+#include <span>
+#include <vector>
 //#include <cassert>
 
 #include <SFML/Graphics.hpp>  // rendertexture
@@ -9,6 +12,9 @@
 
 #include "Globals.hpp"
 #include "Cell.hpp"
+#include "FFT.hpp"
+
+class ThreadPool; // ThreadPool.hpp
 
 
 // DIFFUSIONSCALING //
@@ -22,17 +28,13 @@ constexpr float GetNextFloat(const float x, const int orthodist) {
 
 consteval std::array<float, radialdist_limit+1> CreateDiffusionScale()
 {
+    std::array<float, radialdist_limit+1> diffusionScaling{};
     float x = 1.0f;
-    int orthodist = 0;
-    
-    std::array<float, radialdist_limit+1> diffusionScaling{
-        (1.0f),
-        (x = GetNextFloat(x, ++orthodist), x),
-        (x = GetNextFloat(x, ++orthodist), x),
-        (x = GetNextFloat(x, ++orthodist), x),
-        (x = GetNextFloat(x, ++orthodist), x),
-        (x = GetNextFloat(x, ++orthodist), x),
-    };
+    diffusionScaling[0] = x;
+    for (int orthodist{1}; orthodist <= radialdist_limit; ++orthodist) {
+        x = GetNextFloat(x, orthodist);
+        diffusionScaling[orthodist] = x;
+    }
     return diffusionScaling;
 }
 
@@ -46,37 +48,158 @@ static_assert((DIFFUSIONSCALING[2] > 0.0) && (DIFFUSIONSCALING[2] < 1.0));
 // END DIFFUSIONSCALING //
 
 
+// PADDED GRID //
+// The DiffusionField keeps a copy of the grid surrounded by ghost-cells on each side ('gridPadding', or the diffusion-range if it's wider),
+// so that every stencil-lookup is in-range (no bounds-checks; edge-cells run the same loop as interior-cells).
+// padded-cells are column-major like the cells; (IX, IY) is at ((IX+padding)*paddedSizeY + (IY+padding)).
+// the grid is sized at runtime (SimulationConfig), so the offsets are resolved by DiffusionField::BuildPadding.
+constexpr int gridPadding {radialdist_limit}; // enough for the mouse (GetCellNeighbors) as well as DIFFUSION_RADIUS
+
+// DIFFUSION KERNEL //
+// the diffusion-force is a convolution of the density-grid (see CalcDiffusionField).
+// the stencil's direction is integer-divided (dx/orthodist_sum), so only the axis-aligned cells ever contribute;
+// a cell 'k' steps away along X pushes with DIFFUSIONSCALING[k] in X (and nothing in Y), and likewise for Y.
+// so it's seperable: the X-force is a 1D convolution along the X-axis, and the Y-force along the Y-axis,
+// both with the same antisymmetric kernel. index 0 (the cell itself) is unused.
+using DiffusionKernel = std::array<float, DIFFUSION_RADIUS+1>;
+
+consteval DiffusionKernel CreateDiffusionKernel()
+{
+    DiffusionKernel kernel{};
+    for (const StencilOffset& rel: Stencil<DIFFUSION_RADIUS>) {
+        const int dirX = rel.dx/rel.radialdist;
+        if (dirX != 1) continue; // only the positive X-axis; every axis (and direction) has the same kernel
+        kernel[rel.dx] = DIFFUSIONSCALING[rel.dx]; // on the axis, the diagonal-distance is just dx
+    }
+    return kernel;
+}
+
+constexpr DiffusionKernel DIFFUSIONKERNEL = CreateDiffusionKernel();
+
+static_assert((DIFFUSION_RADIUS == 0) || (DIFFUSIONKERNEL[DIFFUSION_RADIUS] == DIFFUSIONSCALING[DIFFUSION_RADIUS]), "every distance should be filled");
+
+// the kernel for any other diffusion-range (DiffusionField::SetDiffusionRange); same size and layout as DIFFUSIONKERNEL (range+1).
+// DIFFUSIONSCALING only falls off over DIFFUSION_RADIUS (and it turns negative past ~30), so instead of extending it,
+// the same profile is stretched over the range (interpolated), and scaled down to keep the same total weight.
+// returns exactly DIFFUSIONKERNEL for DIFFUSION_RADIUS
+std::vector<float> CreateDiffusionKernel(const int range);
+
+// END PADDED GRID / DIFFUSION KERNEL //
+
+
 class DiffusionField
 {
+    #ifndef FLUIDSIM_HEADLESS
     sf::RenderTexture cellgrid_texture;
+    // the density-grid is uploaded as one pixel per cell, and stretched over the field (nearest-filtering)
+    std::vector<sf::Uint8> density_pixels; // RGBA, row-major (IY*arraySizeX + IX)
+    sf::Texture density_texture;
+    sf::RenderTexture outline_texture; // cell-outlines never change; drawn once during Initialize
+    bool InitializeGridTextures();
+    void UploadDensityPixels(); // draws the density_pixels into the cellgrid_texture
+    #endif
     
-    // these are added with signed-ints in GetCellNeighbors (because the result might be negative); hence the assertion.
-    static_assert((Cell::maxIX < __INT_MAX__) && (Cell::maxIY < __INT_MAX__), "max-indecies will overflow");
-    
-    using CellMatrix = std::array<std::array<Cell*, Cell::arraySizeY>, Cell::arraySizeX>;
+    using CellMatrix = std::vector<std::vector<Cell*>>; // [IX][IY]; sized by Initialize
     //using CellArray = std::array<Cell, ((arraySizeY)*(arraySizeX))>; // crashes
     using CellArray = std::vector<Cell>; // doesn't crash
     CellArray cells; // TODO: figure out how to do this with an array without crashing
     CellMatrix cellmatrix;
     
+    // per-cell state; one dense array per component, indexed by UUID (sized by Initialize, never reallocated)
+    std::vector<float> density;
+    std::vector<float> momentumX, momentumY;   // stored velocity imparted by particles, distributed to local particles
+    std::vector<float> diffusionX, diffusionY; // force calculated from the density of nearby cells
+    
+    public:
+    // semantics of the ghost-cells around the grid
+    enum class Boundary {
+        None,       // out-of-bounds cells are ignored by the diffusion (the original behavior)
+        Empty,      // ghost-cells have zero density
+        Reflective, // ghost-cells mirror the density of the cells across the edge
+        Periodic,   // ghost-cells are the cells on the opposite edge (for neighbor-queries as well)
+    };
+    
+    private:
+    Boundary boundary {Boundary::None};
+    // padded-grid (see PaddedIndex); all rebuilt by BuildPadding, except paddedDensity (SyncPadding)
+    int paddedSizeX{0}, paddedSizeY{0};
+    std::array<int, Stencil<DIFFUSION_RADIUS>.size()> paddedStencil{}; // offsets between padded-cells
+    std::vector<unsigned int> paddedCells;   // UUID of each padded-cell, for neighbor-queries; GhostUUID() if there's none
+    std::vector<unsigned int> paddedSources; // UUID that each padded-cell copies it's density from; GhostUUID() for zero
+    std::vector<float> paddedDensity;
+    // per-cell (by UUID); the kernel summed over the neighbors that the boundary doesn't exclude, signed by direction.
+    // the cell's own density is pushed against every neighbor that exists; this is the only part of that that doesn't cancel
+    // (zero everywhere except along the edges, with Boundary::None)
+    std::vector<float> weightGradientX, weightGradientY;
+    void BuildPadding();
+    
+    public:
+    // how CalcDiffusionField convolves each axis; Auto picks per-axis with PreferFFT
+    enum class DiffusionMethod { Auto, Direct, FFT };
+    
+    private:
+    // the density-gradient (diffusionX/Y) can reach further than DIFFUSION_RADIUS; it's only a convolution, so it isn't tied to the stencils.
+    // everything else (pair-forces, neighbor-queries, the mouse) still uses the compile-time radius
+    int diffusionRange {DIFFUSION_RADIUS};
+    int padding {gridPadding}; // of the padded-grid; max(gridPadding, diffusionRange)
+    DiffusionMethod diffusionMethod {DiffusionMethod::Auto};
+    std::vector<float> rangeKernel; // CreateDiffusionKernel(diffusionRange)
+    FFTConvolution fftLinesX, fftLinesY; // the kernel-spectrums, for each axis' line-length
+    bool useFFTX {false}, useFFTY {false};
+    void PrepareDiffusionKernels(); // called by BuildPadding
+    
+    // one column of CalcDiffusionField (both axes, or either); direct convolution with the kernel
+    void CalcDiffusionColumn(const unsigned int IX, const float scale, const bool alongX, const bool alongY);
+    // pairs of lines for the FFT-path (one transform per pair). along X, each line is a row (index IY); along Y it's a column (IX)
+    void CalcDiffusionLinesFFT(const unsigned int firstPair, const unsigned int lastPair, const float scale, const bool alongX);
+    
     public:
     friend class Simulation;
     friend class Mouse_T;
+    friend struct CellState_T; // Mouse.cpp
+    friend class Benchmark; // Benchmark.cpp
     
     // finds cells at a single distance
     std::vector<Cell*> GetCellNeighbors(const std::size_t UUID) const;
     // finds cells at every distance up to (and including) current DIFFUSION_RADIUS
     std::vector<Cell*> GetCellNeighbors(const std::size_t UUID, const unsigned int radialdist) const;
     std::vector<DoubleCoord> GetAdjacentPlus(const std::size_t UUID) const; // returns pairs of absolute and relative coords
-    sf::Vector2f CalcDiffusionVec(std::size_t UUID) const;
+    // writes the diffusionX/Y of every cell (multiplied by 'scale'); syncs the padded-grid first.
+    // a whole-grid pass, split across the pool by columns; the cost is proportional to the grid-size, not the particles
+    void CalcDiffusionField(ThreadPool& pool, const float scale);
+    
+    // range of the diffusion-field in cells; clamped to [1, MaxDiffusionRange()]. rebuilds the padded-grid
+    void SetDiffusionRange(const int range);
+    // diffusionrange_limit, or less on small grids; same rule as SimulationConfig::Validate for DIFFUSION_RADIUS.
+    // in periodic-mode, a kernel wider than the domain would wrap onto the same cells more than once
+    // (and in reflective-mode, bounce between the edges); the range is the same for every boundary, so it doesn't change with it
+    static int MaxDiffusionRange() {
+        const int domainCells = int(std::min(Cell::maxIX, Cell::maxIY)); // maxIX/maxIY: the cells covering the domain
+        return std::clamp((domainCells - 1) / 2, 1, diffusionrange_limit);
+    }
+    int GetDiffusionRange() const { return diffusionRange; }
+    void SetDiffusionMethod(const DiffusionMethod method) { diffusionMethod = method; PrepareDiffusionKernels(); }
+    DiffusionMethod GetDiffusionMethod() const { return diffusionMethod; }
+    bool UsesFFT() const { return (useFFTX || useFFTY); }
+    // crossover-heuristic between the direct convolution and the FFT, for a single axis;
+    // the direct cost grows with the range, the FFT's only with the (padded) line-length
+    static bool PreferFFT(const int range, const int lineLength);
+    
+    int PaddedIndex(const int IX, const int IY) const { return (IX+padding)*paddedSizeY + (IY+padding); }
+    // one past the last real cell; never occupied (the Simulation's cellIndex reserves an empty slot for it)
+    unsigned int GhostUUID() const { return cells.size(); }
+    sf::Vector2f Momentum(const std::size_t UUID) const { return sf::Vector2f{momentumX[UUID], momentumY[UUID]}; }
+    void AddMomentum(const std::size_t UUID, const sf::Vector2f delta) { momentumX[UUID] += delta.x; momentumY[UUID] += delta.y; }
+    Boundary GetBoundary() const { return boundary; }
+    void SetBoundary(const Boundary newBoundary) { boundary = newBoundary; BuildPadding(); }
+    void SyncPadding(); // copies the cells' densities into the padded-grid
     
     
     bool Initialize()  // returns success/fail
     {
-        if (!cellgrid_texture.create(BOXWIDTH, BOXHEIGHT))
-            return false;
-        
-        cells.reserve((Cell::arraySizeY)*(Cell::arraySizeX));
+        Cell::SetGridSize(config.boxWidth, config.boxHeight);
+        cells.reserve((Cell::arraySizeY)*(Cell::arraySizeX)); // never reallocated; the cellmatrix points into it
+        cellmatrix.assign(Cell::arraySizeX, std::vector<Cell*>(Cell::arraySizeY, nullptr));
         
         unsigned int ID = 0;
         for (unsigned int c{0}; c < (Cell::arraySizeX); ++c) {
@@ -86,29 +209,40 @@ class DiffusionField
                 cellmatrix[c][r] = &newcell;
             }
         }
+        density.assign(cells.size(), 0.0f);
+        momentumX.assign(cells.size(), 0.0f);  momentumY.assign(cells.size(), 0.0f);
+        diffusionX.assign(cells.size(), 0.0f); diffusionY.assign(cells.size(), 0.0f);
+        BuildPadding();
+        
+        #ifndef FLUIDSIM_HEADLESS
+        if (!InitializeGridTextures())
+            return false;
+        #endif
         return true;
     }
     
     void PrintAllCells() const;
     
+    #ifndef FLUIDSIM_HEADLESS
+    static sf::RectangleShape CellShape(const Cell& cell); // the cell's outline; only generated for drawing
     sf::Sprite GetSprite() { return sf::Sprite(cellgrid_texture.getTexture()); }
-    void Redraw() 
-    {
-        cellgrid_texture.clear(sf::Color::Transparent);
-        for (auto& cell : cells) {
-            cell.UpdateColor();
-            cellgrid_texture.draw(cell);
-        }
-        cellgrid_texture.display();
-    }
+    // two draw-calls; the density-texture (scaled up to the cell-size), then the static outlines
+    void Redraw();
+    void Redraw(std::span<const float> densities); // from a copy of the densities instead (indexed by UUID)
+    #endif
     
     void ResetMomentum() {
-        for (Cell& cell: cells) {
-            cell.momentum = {0.0, 0.0};
-        }
+        std::ranges::fill(momentumX, 0.0f);
+        std::ranges::fill(momentumY, 0.0f);
     }
     
-    void Reset() { for (Cell& cell: cells) { cell.Reset(); } }
+    // IX, IY, UUID never change
+    void Reset() {
+        std::ranges::fill(density, 0.0f);
+        ResetMomentum();
+        std::ranges::fill(diffusionX, 0.0f);
+        std::ranges::fill(diffusionY, 0.0f);
+    }
 };
 
 
@@ -0,0 +1,80 @@
+#include "FFT.hpp"
+
+#include <numbers> // pi
+#include <utility> // swap
+#include <cassert>
+
+
+FFTPlan::FFTPlan(const std::size_t size): size{size}
+{
+    assert((size > 0) && ((size & (size-1)) == 0) && "FFT-size must be a power of two");
+    twiddles.resize(size/2);
+    for (std::size_t k{0}; k < size/2; ++k) {
+        // calculated in double-precision; the rounding would otherwise accumulate into the larger transforms
+        const double angle = -2.0 * std::numbers::pi * double(k) / double(size);
+        twiddles[k] = std::complex<float>(std::polar(1.0, angle));
+    }
+
+    bitReversed.resize(size);
+    unsigned int bits {0};
+    while ((std::size_t{1} << bits) < size) { ++bits; }
+    for (std::size_t index{0}; index < size; ++index) {
+        unsigned int reversed {0};
+        for (unsigned int bit{0}; bit < bits; ++bit) {
+            if (index & (std::size_t{1} << bit)) { reversed |= 1u << (bits-1-bit); }
+        }
+        bitReversed[index] = reversed;
+    }
+}
+
+
+void FFTPlan::Transform(std::span<std::complex<float>> data, const bool inverse) const
+{
+    assert((data.size() == size) && "FFT-data doesn't match the plan's size");
+    for (std::size_t index{0}; index < size; ++index) {
+        if (index < bitReversed[index]) { std::swap(data[index], data[bitReversed[index]]); }
+    }
+
+    // butterflies; each pass doubles the length of the sub-transforms
+    for (std::size_t length{2}; length <= size; length *= 2)
+    {
+        const std::size_t half = length/2;
+        const std::size_t twiddleStride = size/length;
+        for (std::size_t start{0}; start < size; start += length) {
+            for (std::size_t k{0}; k < half; ++k) {
+                const std::complex<float> twiddle = inverse? std::conj(twiddles[k*twiddleStride]) : twiddles[k*twiddleStride];
+                const std::complex<float> odd = data[start+k+half] * twiddle;
+                data[start+k+half] = data[start+k] - odd;
+                data[start+k]      = data[start+k] + odd;
+            }
+        }
+    }
+
+    if (inverse) {
+        const float scaling = 1.0f / float(size);
+        for (std::complex<float>& value: data) { value *= scaling; }
+    }
+}
+
+
+void FFTConvolution::Prepare(const std::size_t minimumLength, std::span<const float> kernel, const int range)
+{
+    assert((kernel.size() == std::size_t(2*range + 1)) && "kernel should cover [-range, range]");
+    const std::size_t size = FFTPlan::NextPowerOfTwo(minimumLength);
+    if (plan.Size() != size) { plan = FFTPlan(size); }
+
+    // negative offsets wrap around to the end
+    kernelSpectrum.assign(size, {0.0f, 0.0f});
+    for (int m{-range}; m <= range; ++m) {
+        kernelSpectrum[(m + int(size)) % int(size)] = kernel[m + range];
+    }
+    plan.Forward(kernelSpectrum);
+}
+
+
+void FFTConvolution::Convolve(std::span<std::complex<float>> lines) const
+{
+    plan.Forward(lines);
+    for (std::size_t index{0}; index < lines.size(); ++index) { lines[index] *= kernelSpectrum[index]; }
+    plan.Inverse(lines);
+}
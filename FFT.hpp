@@ -0,0 +1,53 @@
+#ifndef FLUIDSIM_FFT_HPP_INCLUDED
+#define FLUIDSIM_FFT_HPP_INCLUDED
+
+#include <vector>
+#include <span>
+#include <complex>
+#include <cstddef> // size_t
+
+
+// Iterative radix-2 FFT (in-place, single-precision); the size must be a power of two.
+// The twiddle-factors and the bit-reversal permutation are computed once, when the plan is created.
+class FFTPlan
+{
+    std::size_t size {0};
+    std::vector<std::complex<float>> twiddles; // exp(-2*pi*i*k/size), for k < size/2
+    std::vector<unsigned int> bitReversed;     // index that each element is swapped with before the butterflies
+
+    void Transform(std::span<std::complex<float>> data, const bool inverse) const;
+
+    public:
+    FFTPlan() = default;
+    explicit FFTPlan(const std::size_t size);
+
+    std::size_t Size() const { return size; }
+    void Forward(std::span<std::complex<float>> data) const { Transform(data, false); }
+    void Inverse(std::span<std::complex<float>> data) const { Transform(data, true); } // includes the 1/size scaling
+
+    static std::size_t NextPowerOfTwo(const std::size_t minimum) {
+        std::size_t result {1};
+        while (result < minimum) { result *= 2; }
+        return result;
+    }
+};
+
+
+// Convolution of real lines with a fixed real kernel, through the FFT: out[n] = sum(kernel[m] * in[n-m]), for m in [-range, range].
+// it's circular over the transform-size, so lines must be padded to at least (length + 2*range) to avoid wrapping around.
+// the kernel is real, so two lines are convolved per transform; one in the real part, and the other in the imaginary part.
+class FFTConvolution
+{
+    FFTPlan plan;
+    std::vector<std::complex<float>> kernelSpectrum;
+
+    public:
+    // 'kernel' is indexed by (m + range); resizes the transform to fit 'minimumLength'
+    void Prepare(const std::size_t minimumLength, std::span<const float> kernel, const int range);
+    std::size_t Size() const { return plan.Size(); }
+    // 'lines' must have Size() elements; transformed in-place
+    void Convolve(std::span<std::complex<float>> lines) const;
+};
+
+
+#endif
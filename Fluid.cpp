@@ -4,11 +4,12 @@
 //#include <vector>
 //#include <numeric>
 #include <cmath>
+#include <algorithm> // clamp/min
 #include <cassert>
 #include <array>    // required only for speedcap_counter/Stats
 #include <iostream> // required only for speedcap_counter/Stats
+#include <atomic>   // the counters are incremented from every pool-worker
 
-#include <SFML/Graphics/CircleShape.hpp>
 #include <SFML/Graphics/RenderWindow.hpp>
 #include <SFML/System/Time.hpp>
 
@@ -16,33 +17,34 @@
 bool Fluid::isParticleScalingPositive = true;
 
 // counts how many times the speedcaps were broken
-static std::array<std::size_t, 4> speedcap_counter{0,0,0,0};
+// (relaxed atomics; they're only stats, but UpdatePositions and the pair-forces run on every pool-worker)
+static std::array<std::atomic<std::size_t>, 4> speedcap_counter{0,0,0,0};
 // counts the number of times two particles shared EXACTLY the same position (in CalcLocalForce)
-static int exactOverlapCounter{0};
+static std::atomic<int> exactOverlapCounter{0};
 
 void PrintSpeedcapInfo()
 {
     std::cout << '\n';
     std::cout << "speedcap_x: \t"
-        << "soft: " << speedcap_counter[0] << " | "
-        << "hard: " << speedcap_counter[2] << '\n';
+        << "soft: " << speedcap_counter[0].load() << " | "
+        << "hard: " << speedcap_counter[2].load() << '\n';
     std::cout << "speedcap_y: \t"
-        << "soft: " << speedcap_counter[1] << " | "
-        << "hard: " << speedcap_counter[3] << '\n';
+        << "soft: " << speedcap_counter[1].load() << " | "
+        << "hard: " << speedcap_counter[3].load() << '\n';
     std::cout << '\n';
     
-    std::cout << "Exact overlaps: " << exactOverlapCounter << '\n';
+    std::cout << "Exact overlaps: " << exactOverlapCounter.load() << '\n';
     return;
 }
 
 
-void Fluid::Particle::ApplySpeedcap()
+void Fluid::ApplySpeedcap(float& vx, float& vy)
 {
     // TODO: figure out something better for the softcap
-    if      (std::abs(velocity.x) > speedcap_hard) [[unlikely]] { velocity.x  = 0.0f; ++speedcap_counter[2]; }
-    else if (std::abs(velocity.x) > speedcap_soft) [[unlikely]] { velocity.x *= 0.5f; ++speedcap_counter[0]; }
-    if      (std::abs(velocity.y) > speedcap_hard) [[unlikely]] { velocity.y  = 0.0f; ++speedcap_counter[3]; }
-    else if (std::abs(velocity.y) > speedcap_soft) [[unlikely]] { velocity.y *= 0.5f; ++speedcap_counter[1]; }
+    if      (std::abs(vx) > speedcap_hard) [[unlikely]] { vx  = 0.0f; speedcap_counter[2].fetch_add(1, std::memory_order_relaxed); }
+    else if (std::abs(vx) > speedcap_soft) [[unlikely]] { vx *= 0.5f; speedcap_counter[0].fetch_add(1, std::memory_order_relaxed); }
+    if      (std::abs(vy) > speedcap_hard) [[unlikely]] { vy  = 0.0f; speedcap_counter[3].fetch_add(1, std::memory_order_relaxed); }
+    else if (std::abs(vy) > speedcap_soft) [[unlikely]] { vy *= 0.5f; speedcap_counter[1].fetch_add(1, std::memory_order_relaxed); }
     // do NOT return in the if-statements (or you might be left with the other axis still invalid)
     return;
     
@@ -65,53 +67,126 @@ float Fluid::gradient_thresholdHigh{32.00f}; // caps out the gradient
 Gradient_T* Fluid::activeGradient{nullptr};
 
 
-void Fluid::Particle::UpdateColor(const bool useTransparency)
+#ifndef FLUIDSIM_HEADLESS
+void Fluid::UpdateQuad(sf::Vertex* quad, const sf::Vector2f position, const sf::Vector2f velocity, const bool useTransparency)
 {
     const float speed = std::abs(velocity.x) + std::abs(velocity.y);
     float inputRange = gradient_thresholdHigh-gradient_thresholdLow;
     unsigned int speedindex;
     const unsigned int baseAlpha = (useTransparency? 0xC0 : 0xFF);
     unsigned char alpha = baseAlpha;  // eventually converted to sf::Uint8 - which is unsigned char (not int)
-    if (speed <= gradient_thresholdLow) { speedindex = 0; setScale({1.0f, 1.0f}); }
-    else if (speed >= gradient_thresholdHigh) { speedindex = 1023; }  // size of gradient
+    float scale {1.0f};
+    if (speed <= gradient_thresholdLow) { speedindex = 0; }
     else {
-        speedindex = (speed - gradient_thresholdLow) * (1023.f/inputRange);
-        assert(speedindex <= 1023);
+        // speeds past the upper threshold are clamped to the end of the gradient
+        const float clamped = std::min(speed, gradient_thresholdHigh);
+        speedindex = (clamped - gradient_thresholdLow) * (1023.f/inputRange);
+        assert(speedindex <= 1023); // size of gradient
         if (useTransparency) {
-            alpha = baseAlpha + ((speed - gradient_thresholdLow) * ((0xFF-baseAlpha)/inputRange));
+            alpha = baseAlpha + ((clamped - gradient_thresholdLow) * ((0xFF-baseAlpha)/inputRange));
             assert(alpha < 256);
         }
-        float particleScaling = ((speed - gradient_thresholdLow)/inputRange);
+        float particleScaling = ((clamped - gradient_thresholdLow)/inputRange);
         // faster particles grow
-        float scale = 1.0f + ((Fluid::isParticleScalingPositive)? particleScaling : -particleScaling);
-        setScale({scale, scale});
+        scale = 1.0f + ((Fluid::isParticleScalingPositive)? particleScaling : -particleScaling);
     }
     const auto[r, g, b, a] = activeGradient->Lookup(speedindex);
-    setFillColor({r,g,b,alpha});
+    const sf::Color color {r,g,b,alpha};
+    
+    // position is the top-left corner (same origin that sf::CircleShape scaled from)
+    const float size = DEFAULTRADIUS * 2.f * scale;
+    constexpr float T = float(circleTextureSize);
+    quad[0] = sf::Vertex{position,                             color, {0.f, 0.f}};
+    quad[1] = sf::Vertex{{position.x + size, position.y},      color, {T,   0.f}};
+    quad[2] = sf::Vertex{{position.x + size, position.y+size}, color, {T,   T  }};
+    quad[3] = sf::Vertex{{position.x, position.y + size},      color, {0.f, T  }};
     return;
 }
 
 
+void Fluid::Redraw(const ParticleState& state, const bool useTransparency, const bool shouldClear, const float interpolation)
+{
+    const bool shouldInterpolate = (interpolation < 1.0f) && (previousX.size() == state.size());
+    // particles that wrapped around (periodic-mode) would be drawn sweeping across the whole field; those just snap
+    const float wrapThresholdX = config.boxWidth/2.f, wrapThresholdY = config.boxHeight/2.f;
+    
+    // the vertices only get synced with the simulation-state here
+    vertices.resize(state.size() * 4);
+    for (std::size_t ID{0}; ID < state.size(); ++ID) {
+        sf::Vector2f position = state.Position(ID);
+        if (shouldInterpolate) {
+            const sf::Vector2f previous {previousX[ID], previousY[ID]};
+            const sf::Vector2f delta = position - previous;
+            if ((std::abs(delta.x) < wrapThresholdX) && (std::abs(delta.y) < wrapThresholdY)) {
+                position = previous + delta*interpolation;
+            }
+        }
+        UpdateQuad(&vertices[ID*4], position, state.Velocity(ID), useTransparency);
+    }
+    
+    if(shouldClear) particle_texture.clear(sf::Color::Transparent);
+    particle_texture.draw(vertices.data(), vertices.size(), sf::Quads, sf::RenderStates{&circle_texture});
+    particle_texture.display();
+}
+
+
+// white circle (with a one-pixel antialiased edge) for the particle-quads; the vertex-colors tint it
+static sf::Image RasterizeCircle(const unsigned int size)
+{
+    sf::Image image;
+    image.create(size, size, sf::Color::Transparent);
+    const float radius = size / 2.f;
+    for (unsigned int py{0}; py < size; ++py) {
+        for (unsigned int px{0}; px < size; ++px) {
+            const float dx = (px + 0.5f) - radius;
+            const float dy = (py + 0.5f) - radius;
+            const float coverage = std::clamp(radius - std::sqrt(dx*dx + dy*dy), 0.f, 1.f);
+            image.setPixel(px, py, {0xFF, 0xFF, 0xFF, sf::Uint8(coverage * 0xFF)});
+        }
+    }
+    return image;
+}
+#endif
+
+
 // calculations for initial positioning of particles
-static constexpr float INITIALSPACINGX {BOXWIDTH/NUMCOLUMNS};
-static constexpr float INITIALSPACINGY {BOXHEIGHT/NUMROWS};
-static constexpr float INITIALOFFSETX {(INITIALSPACINGX/2.0f) - DEFAULTRADIUS};
-static constexpr float INITIALOFFSETY {(INITIALSPACINGY/2.0f) - DEFAULTRADIUS};
+// (integer division is intentional; matches the original constexpr spacing for the default layout)
+sf::Vector2f Fluid::InitialPosition(const int column, const int row) const
+{
+    const float spacingX {float(config.boxWidth/columns)};
+    const float spacingY {float(config.boxHeight/rows)};
+    const float offsetX {(spacingX/2.0f) - DEFAULTRADIUS};
+    const float offsetY {(spacingY/2.0f) - DEFAULTRADIUS};
+    return {(column*spacingX)+offsetX, (row*spacingY)+offsetY};
+}
 
-bool Fluid::Initialize()
+bool Fluid::Initialize(const int columnCount, const int rowCount)
 {
     assert((bounceDampening >= 0.0) && (bounceDampening <= 1.0) && "collision-damping must be between 0 and 1");
-    assert((activeGradient != nullptr) && "Fluid's gradient was never set");
+    // the particles would spawn on top of each other (or outside the box)
+    if ((columnCount <= 0) || (rowCount <= 0) || (columnCount > config.boxWidth) || (rowCount > config.boxHeight)) {
+        std::cerr << "invalid particle layout: " << columnCount << 'x' << rowCount << '\n';
+        return false;
+    }
+    columns = columnCount;
+    rows = rowCount;
     
-    if (!particle_texture.create(BOXWIDTH, BOXHEIGHT))
+    #ifndef FLUIDSIM_HEADLESS
+    assert((activeGradient != nullptr) && "Fluid's gradient was never set");
+    if (!particle_texture.create(config.boxWidth, config.boxHeight))
+        return false;
+    if (!circle_texture.loadFromImage(RasterizeCircle(circleTextureSize)))
         return false;
+    circle_texture.setSmooth(true);
+    vertices.resize(columns*rows*4);
+    #endif
     
     unsigned int nextID{0};
-    particles.reserve(NUMCOLUMNS*NUMROWS);
-    for (int c{0}; c < NUMCOLUMNS; ++c) { 
-        for (int r{0}; r < NUMROWS; ++r) {
-            Particle& particle = particles.emplace_back(nextID++);
-            particle.setPosition((c*INITIALSPACINGX)+INITIALOFFSETX, (r*INITIALSPACINGY)+INITIALOFFSETY);
+    particles.resize(columns*rows);
+    for (int c{0}; c < columns; ++c) { 
+        for (int r{0}; r < rows; ++r) {
+            const unsigned int ID = nextID++;
+            particles.SetPosition(ID, InitialPosition(c, r));
             // the particles still need their Cell-related variables set
             // and the cells need to have their density increased
         }
@@ -122,28 +197,17 @@ bool Fluid::Initialize()
 
 void Fluid::Reset()
 {
+    previousX.clear(); previousY.clear(); // nothing to interpolate from
     int c{0}; int r{0};
-    for (Particle& particle: particles) {
-        particle.cellID = -1;
-        particle.velocity = {0,0};
-        if (++c >= NUMCOLUMNS) { c=0; ++r; }
-        particle.setPosition((c*INITIALSPACINGX)+INITIALOFFSETX, (r*INITIALSPACINGY)+INITIALOFFSETY);
+    for (std::size_t ID{0}; ID < particles.size(); ++ID) {
+        particles.cellID[ID] = -1;
+        particles.SetVelocity(ID, {0,0});
+        if (++c >= columns) { c=0; ++r; }
+        particles.SetPosition(ID, InitialPosition(c, r));
         // the particles still need their Cell-related variables set, and the cells need to have their density increased
     }
 }
 
-float Fluid::Particle::Distance(const Particle& rh) const
-{
-    auto [diffx, diffy] = this->getPosition() - rh.getPosition();
-    return std::sqrt((diffx*diffx) + (diffy*diffy)); // pythagorean theorem
-}
-
-float Fluid::Particle::Distance(const Particle& lh, const Particle& rh)
-{
-    auto [diffx, diffy] = lh.getPosition() - rh.getPosition();
-    return std::sqrt((diffx*diffx) + (diffy*diffy));
-}
-
 
 // MSVC really doesn't believe that cmath functions( std::sqrt/cos) are constexpr (they are since C++23)
 #define PLZ_STOPCOMPLAINING_MSCPP
@@ -154,15 +218,16 @@ float Fluid::Particle::Distance(const Particle& lh, const Particle& rh)
 #endif
 
 // calculates diffusion-force between particles within the same cell
-sf::Vector2f Fluid::CalcLocalForce(const Fluid::Particle& lh, const Fluid::Particle& rh, float fdensity)
+sf::Vector2f Fluid::CalcLocalForce(const ParticleState& state, const unsigned int lh, const unsigned int rh, float fdensity)
 {
     // the distance between two opposite corners of a cell (pythagorean theorem)
     CONSTEXPR float intracellDistMax{std::sqrt(SPATIAL_RESOLUTION*SPATIAL_RESOLUTION*2)};
     CONSTEXPR float maxdist = intracellDistMax*(radialdist_limit+1);
     
-    const auto [diffx, diffy] = lh.getPosition() - rh.getPosition();
+    const float diffx = state.x[lh] - state.x[rh];
+    const float diffy = state.y[lh] - state.y[rh];
     const float totalDistance = std::sqrt((diffx*diffx) + (diffy*diffy));
-    if(totalDistance == 0.f) [[unlikely]] { ++exactOverlapCounter; return -lh.velocity*timestepRatio*fdensity; }  // TODO: should return random direction, ideally
+    if(totalDistance == 0.f) [[unlikely]] { exactOverlapCounter.fetch_add(1, std::memory_order_relaxed); return -state.Velocity(lh)*timestepRatio*fdensity; }  // TODO: should return random direction, ideally
     
     // mapping to output range of: 0 to PI/2 (cosine hits zero at PI/2)
     const float normalized = (totalDistance/maxdist) * (M_PI/2.f);
@@ -179,48 +244,289 @@ sf::Vector2f Fluid::CalcLocalForce(const Fluid::Particle& lh, const Fluid::Parti
 #undef CONSTEXPR
 
 
-// particle positions still use top-left corner, so the non-zero boundary needs adjustment
-#define ADJ_BOXHEIGHT (BOXHEIGHT-DEFAULTRADIUS)
-#define ADJ_BOXWIDTH  ( BOXWIDTH-DEFAULTRADIUS)
+// AVX-512 / AVX2 versions of AccumulatePairForces are selected at compile-time (by -march=native); scalar otherwise
+#if defined(__AVX512F__)
+  #define PAIRFORCES_AVX512
+#elif defined(__AVX2__) && defined(__FMA__)
+  #define PAIRFORCES_AVX2
+#endif
+#if defined(PAIRFORCES_AVX512) || defined(PAIRFORCES_AVX2)
+  #include <immintrin.h>
+#endif
 
+// maxdist (from CalcLocalForce) squared; doesn't need the sqrt, so it can actually be constexpr
+constexpr float pairforce_maxdistSq {float(SPATIAL_RESOLUTION*SPATIAL_RESOLUTION*2) * float((radialdist_limit+1)*(radialdist_limit+1))};
+constexpr float pairforce_invMaxdistSq {1.f / pairforce_maxdistSq};
 
-void Fluid::UpdatePositions()
+// cos^3((PI/2)*x) as a polynomial of x^2, over x in [0, 1] (least-squares fit; max abs-error ~6.6e-7).
+// taking the squared distance directly means neither sqrt nor cos is needed
+constexpr std::array<float, 7> cubedcosine_coeffs {
+    9.999993432e-01f, -3.701036798e+00f, 5.326011585e+00f, -3.811639533e+00f,
+    1.489896559e+00f, -3.437900500e-01f, 4.055952046e-02f,
+};
+
+static inline float CubedCosineApprox(const float s) // s = x^2
+{
+    float result = cubedcosine_coeffs[6];
+    for (int C{5}; C >= 0; --C) { result = result*s + cubedcosine_coeffs[C]; }
+    return result;
+}
+
+// the exact falloff from CalcLocalForce, in terms of s = (distance/maxdist)^2
+static inline float CubedCosineExact(const float s)
+{
+    const float cosine = std::cos(std::sqrt(s) * float(M_PI/2.f));
+    return cosine*cosine*cosine;
+}
+
+
+// Falloff sampled at 'size' uniform intervals of s, linearly interpolated ('fast-math' mode; Fluid::useForceTable).
+// s is clamped to [0, 1]; the padding entry past the end lets s == 1.0 interpolate without a bounds-check.
+template <std::size_t size>
+struct FalloffTable
+{
+    std::array<float, size+2> values;
+    
+    FalloffTable() {
+        for (std::size_t index{0}; index < values.size(); ++index) {
+            values[index] = CubedCosineExact(std::min(float(index) / float(size), 1.f));
+        }
+    }
+    
+    float Lookup(const float s) const {
+        const float scaled = s * float(size);
+        const int index = int(scaled);
+        const float fraction = scaled - float(index);
+        return values[index] + (values[index+1] - values[index]) * fraction;
+    }
+};
+
+// see PrintForceTableAccuracy for the error at other sizes
+constexpr std::size_t forcetable_size {1024};
+static const FalloffTable<forcetable_size> forceTable{};
+bool Fluid::useForceTable {false};
+
+
+// max error of each falloff approximation against the exact formula (absolute; the falloff ranges from 0 to 1).
+// sampled uniformly over the distance, since that's how pairs are actually distributed
+void PrintForceTableAccuracy()
+{
+    constexpr int samplecount {1000000};
+    const auto MaxError = [](const auto& Approximation) {
+        double maxerror {0.0};
+        for (int sample{0}; sample <= samplecount; ++sample) {
+            const double x = double(sample) / samplecount;
+            const double exact = std::pow(std::cos(x * (M_PI/2.0)), 3);
+            maxerror = std::max(maxerror, std::abs(double(Approximation(float(x*x))) - exact));
+        }
+        return maxerror;
+    };
+    const auto TableError = [&MaxError]<std::size_t size>() {
+        static const FalloffTable<size> table{};
+        std::cout << "  table[" << size << "]: \t" << MaxError([](const float s){ return table.Lookup(s); })
+                  << " \t(" << (size+2)*sizeof(float) << " bytes)" << (size == forcetable_size? " <- current" : "") << '\n';
+    };
+    
+    std::cout << "\nmax abs-error of the pair-force falloff (cos^3):\n";
+    std::cout << "  polynomial: \t" << MaxError(CubedCosineApprox) << '\n';
+    TableError.operator()<64>();
+    TableError.operator()<256>();
+    TableError.operator()<1024>();
+    TableError.operator()<4096>();
+    TableError.operator()<16384>();
+    std::cout << "  float-exact: \t" << MaxError(CubedCosineExact) << " \t(float rounding)\n";
+    return;
+}
+
+
+sf::Vector2f Fluid::AccumulatePairForces(const float px, const float py, const sf::Vector2f overlapForce,
+    const float* xs, const float* ys, float* fx, float* fy, const std::size_t count, const float scale)
 {
-    for (Particle& particle: particles) 
+    sf::Vector2f total {0.f, 0.f};
+    int overlaps {0};
+    std::size_t index {0};
+    
+    #if defined(PAIRFORCES_AVX512)
+    const __m512 vpx = _mm512_set1_ps(px), vpy = _mm512_set1_ps(py);
+    const __m512 vinv = _mm512_set1_ps(pairforce_invMaxdistSq), vone = _mm512_set1_ps(1.f);
+    const __m512 vscale = _mm512_set1_ps(scale);
+    const __m512 voverlapX = _mm512_set1_ps(overlapForce.x), voverlapY = _mm512_set1_ps(overlapForce.y);
+    __m512 sumx = _mm512_setzero_ps(), sumy = _mm512_setzero_ps();
+    // GCC 12's unmasked forms of some intrinsics (min, conversions, gathers, reduce) pass a self-initialized
+    // '_mm512_undefined_ps()' as the merge-source, which trips -Wmaybe-uninitialized (GCC bug 105593, fixed in 13).
+    // the zero-masked forms (with every lane active) compile to the same instructions, without the warning
+    const __mmask16 all {0xFFFF};
+    // the tail is handled with a partial mask, instead of a scalar loop
+    for (; index < count; index += 16)
     {
-        particle.ApplyViscosity(viscosity);
-        particle.ApplySpeedcap();
+        const std::size_t remaining = count - index;
+        const __mmask16 active = (remaining >= 16)? __mmask16(0xFFFF) : __mmask16((1u << remaining) - 1);
+        const __m512 dx = _mm512_sub_ps(vpx, _mm512_maskz_loadu_ps(active, xs+index));
+        const __m512 dy = _mm512_sub_ps(vpy, _mm512_maskz_loadu_ps(active, ys+index));
+        const __m512 distSq = _mm512_fmadd_ps(dx, dx, _mm512_mul_ps(dy, dy));
+        const __m512 s = _mm512_maskz_min_ps(all, _mm512_mul_ps(distSq, vinv), vone);
         
-        sf::Vector2f nextPosition = particle.getPosition();
-        nextPosition.x += particle.velocity.x * timestepRatio;
-        nextPosition.y += particle.velocity.y * timestepRatio;
-        
-        // TODO: refactor bounding-box checks into a seperate function
-        //  keeping all particles within bounding box
-        // we must not allow position == limit in this function;
-        // otherwise, when we look up the related cell, it'll index past the end of the cellmatrix
-        if (nextPosition.y > ADJ_BOXHEIGHT) {
-            nextPosition.y = BOXHEIGHT -(DEFAULTRADIUS*2.f);
-            particle.velocity.y *= (-1.0 + bounceDampening);
+        __m512 poly;
+        if (useForceTable) {
+            const __m512 scaled = _mm512_mul_ps(s, _mm512_set1_ps(float(forcetable_size)));
+            const __m512i tableIndex = _mm512_maskz_cvttps_epi32(all, scaled);
+            const __m512 fraction = _mm512_sub_ps(scaled, _mm512_maskz_cvtepi32_ps(all, tableIndex));
+            const __m512 lower = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), all, tableIndex, forceTable.values.data(),   4);
+            const __m512 upper = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), all, tableIndex, forceTable.values.data()+1, 4);
+            poly = _mm512_fmadd_ps(_mm512_sub_ps(upper, lower), fraction, lower);
+        } else {
+            poly = _mm512_set1_ps(cubedcosine_coeffs[6]);
+            for (int C{5}; C >= 0; --C) { poly = _mm512_fmadd_ps(poly, s, _mm512_set1_ps(cubedcosine_coeffs[C])); }
         }
-        else if (nextPosition.y < 0) {
-            nextPosition.y = -1*nextPosition.y;
-            particle.velocity.y *= (-1.0 + bounceDampening);
+        
+        // direction is the ratio of each axis to the orthogonal distance (same as CalcLocalForce)
+        const __m512 denominator = _mm512_add_ps(_mm512_abs_ps(dx), _mm512_abs_ps(dy));
+        const __m512 ratio = _mm512_div_ps(_mm512_mul_ps(poly, vscale), denominator);
+        const __mmask16 overlapping = _mm512_mask_cmp_ps_mask(active, distSq, _mm512_setzero_ps(), _CMP_EQ_OQ);
+        const __m512 forcex = _mm512_mask_blend_ps(overlapping, _mm512_mul_ps(dx, ratio), voverlapX);
+        const __m512 forcey = _mm512_mask_blend_ps(overlapping, _mm512_mul_ps(dy, ratio), voverlapY);
+        
+        sumx = _mm512_mask_add_ps(sumx, active, sumx, forcex);
+        sumy = _mm512_mask_add_ps(sumy, active, sumy, forcey);
+        _mm512_mask_storeu_ps(fx+index, active, _mm512_sub_ps(_mm512_maskz_loadu_ps(active, fx+index), forcex));
+        _mm512_mask_storeu_ps(fy+index, active, _mm512_sub_ps(_mm512_maskz_loadu_ps(active, fy+index), forcey));
+        overlaps += __builtin_popcount(overlapping);
+    }
+    // horizontal sums (not _mm512_reduce_add_ps; see above)
+    alignas(64) std::array<float, 16> lanesx, lanesy;
+    _mm512_store_ps(lanesx.data(), sumx);
+    _mm512_store_ps(lanesy.data(), sumy);
+    for (int lane{0}; lane < 16; ++lane) { total.x += lanesx[lane]; total.y += lanesy[lane]; }
+    
+    #elif defined(PAIRFORCES_AVX2)
+    const __m256 vpx = _mm256_set1_ps(px), vpy = _mm256_set1_ps(py);
+    const __m256 vinv = _mm256_set1_ps(pairforce_invMaxdistSq), vone = _mm256_set1_ps(1.f);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256 voverlapX = _mm256_set1_ps(overlapForce.x), voverlapY = _mm256_set1_ps(overlapForce.y);
+    const __m256 signmask = _mm256_set1_ps(-0.f);
+    __m256 sumx = _mm256_setzero_ps(), sumy = _mm256_setzero_ps();
+    for (; index + 8 <= count; index += 8)
+    {
+        const __m256 dx = _mm256_sub_ps(vpx, _mm256_loadu_ps(xs+index));
+        const __m256 dy = _mm256_sub_ps(vpy, _mm256_loadu_ps(ys+index));
+        const __m256 distSq = _mm256_fmadd_ps(dx, dx, _mm256_mul_ps(dy, dy));
+        const __m256 s = _mm256_min_ps(_mm256_mul_ps(distSq, vinv), vone);
+        
+        __m256 poly;
+        if (useForceTable) {
+            const __m256 scaled = _mm256_mul_ps(s, _mm256_set1_ps(float(forcetable_size)));
+            const __m256i tableIndex = _mm256_cvttps_epi32(scaled);
+            const __m256 fraction = _mm256_sub_ps(scaled, _mm256_cvtepi32_ps(tableIndex));
+            const __m256 lower = _mm256_i32gather_ps(forceTable.values.data(),   tableIndex, 4);
+            const __m256 upper = _mm256_i32gather_ps(forceTable.values.data()+1, tableIndex, 4);
+            poly = _mm256_fmadd_ps(_mm256_sub_ps(upper, lower), fraction, lower);
+        } else {
+            poly = _mm256_set1_ps(cubedcosine_coeffs[6]);
+            for (int C{5}; C >= 0; --C) { poly = _mm256_fmadd_ps(poly, s, _mm256_set1_ps(cubedcosine_coeffs[C])); }
         }
         
-        if (nextPosition.x > ADJ_BOXWIDTH) {
-            nextPosition.x = BOXWIDTH - (DEFAULTRADIUS*2.f);
-            particle.velocity.x *= (-1.0 + bounceDampening);
+        const __m256 denominator = _mm256_add_ps(_mm256_andnot_ps(signmask, dx), _mm256_andnot_ps(signmask, dy));
+        const __m256 ratio = _mm256_div_ps(_mm256_mul_ps(poly, vscale), denominator);
+        const __m256 overlapping = _mm256_cmp_ps(distSq, _mm256_setzero_ps(), _CMP_EQ_OQ);
+        const __m256 forcex = _mm256_blendv_ps(_mm256_mul_ps(dx, ratio), voverlapX, overlapping);
+        const __m256 forcey = _mm256_blendv_ps(_mm256_mul_ps(dy, ratio), voverlapY, overlapping);
+        
+        sumx = _mm256_add_ps(sumx, forcex);
+        sumy = _mm256_add_ps(sumy, forcey);
+        _mm256_storeu_ps(fx+index, _mm256_sub_ps(_mm256_loadu_ps(fx+index), forcex));
+        _mm256_storeu_ps(fy+index, _mm256_sub_ps(_mm256_loadu_ps(fy+index), forcey));
+        overlaps += __builtin_popcount(_mm256_movemask_ps(overlapping));
+    }
+    // horizontal sums
+    alignas(32) std::array<float, 8> lanesx, lanesy;
+    _mm256_store_ps(lanesx.data(), sumx);
+    _mm256_store_ps(lanesy.data(), sumy);
+    for (int lane{0}; lane < 8; ++lane) { total.x += lanesx[lane]; total.y += lanesy[lane]; }
+    #endif
+    
+    // scalar version; also handles the remainder of the AVX2 loop
+    for (; index < count; ++index)
+    {
+        const float dx = px - xs[index];
+        const float dy = py - ys[index];
+        const float distSq = (dx*dx) + (dy*dy);
+        sf::Vector2f force = overlapForce;
+        if (distSq != 0.f) [[likely]] {
+            const float s = std::min(distSq * pairforce_invMaxdistSq, 1.f);
+            const float magnitude = (useForceTable? forceTable.Lookup(s) : CubedCosineApprox(s)) * scale;
+            const float ratio = magnitude / (std::abs(dx) + std::abs(dy));
+            force = {dx*ratio, dy*ratio};
+        } else { ++overlaps; }
+        
+        total += force;
+        fx[index] -= force.x;
+        fy[index] -= force.y;
+    }
+    
+    if (overlaps > 0) [[unlikely]] { exactOverlapCounter.fetch_add(overlaps, std::memory_order_relaxed); }
+    return total;
+}
+
+
+// particle positions still use top-left corner, so the non-zero boundary needs adjustment
+#define ADJ_BOXHEIGHT (config.boxHeight-DEFAULTRADIUS)
+#define ADJ_BOXWIDTH  ( config.boxWidth-DEFAULTRADIUS)
+
+// periodic-mode; wraps a position into [0, period)
+static inline float WrapPeriodic(const float position, const float period)
+{
+    const float wrapped = position - period*std::floor(position/period);
+    return (wrapped < period)? wrapped : 0.0f; // rounding can land exactly on the period
+}
+
+
+void Fluid::UpdatePositions()
+{
+    const float viscosityMultiplier = (1.0f - (viscosity * timestepRatio)); // ideally cell-density would be accounted for here
+    for (std::size_t ID{0}; ID < particles.size(); ++ID)
+    {
+        float& vx = particles.vx[ID];
+        float& vy = particles.vy[ID];
+        vx *= viscosityMultiplier;
+        vy *= viscosityMultiplier;
+        ApplySpeedcap(vx, vy);
+        
+        sf::Vector2f nextPosition = particles.Position(ID);
+        nextPosition.x += vx * timestepRatio;
+        nextPosition.y += vy * timestepRatio;
+        
+        if (isPeriodic) {
+            nextPosition.x = WrapPeriodic(nextPosition.x, config.PeriodicWidth());
+            nextPosition.y = WrapPeriodic(nextPosition.y, config.PeriodicHeight());
         }
-        else if (nextPosition.x < 0) {
-            nextPosition.x = -1*nextPosition.x;
-            particle.velocity.x *= (-1.0 + bounceDampening);
+        else {
+            // TODO: refactor bounding-box checks into a seperate function
+            //  keeping all particles within bounding box
+            // we must not allow position == limit in this function;
+            // otherwise, when we look up the related cell, it'll index past the end of the cellmatrix
+            if (nextPosition.y > ADJ_BOXHEIGHT) {
+                nextPosition.y = config.boxHeight -(DEFAULTRADIUS*2.f);
+                vy *= (-1.0 + bounceDampening);
+            }
+            else if (nextPosition.y < 0) {
+                nextPosition.y = -1*nextPosition.y;
+                vy *= (-1.0 + bounceDampening);
+            }
+            
+            if (nextPosition.x > ADJ_BOXWIDTH) {
+                nextPosition.x = config.boxWidth - (DEFAULTRADIUS*2.f);
+                vx *= (-1.0 + bounceDampening);
+            }
+            else if (nextPosition.x < 0) {
+                nextPosition.x = -1*nextPosition.x;
+                vx *= (-1.0 + bounceDampening);
+            }
         }
         
         assert((nextPosition.x >= 0) && (nextPosition.y >= 0) && "negative nextPosition!");
-        assert((nextPosition.x <= BOXWIDTH) && (nextPosition.y <= BOXHEIGHT) && "OOB nextPosition!");
+        assert((nextPosition.x < config.PeriodicWidth()) && (nextPosition.y < config.PeriodicHeight()) && "OOB nextPosition!");
         
-        particle.setPosition(nextPosition);
+        particles.SetPosition(ID, nextPosition);
     }
     
     return;
@@ -228,49 +534,58 @@ void Fluid::UpdatePositions()
 
 
 // multithreaded version
-void Fluid::UpdatePositions(const std::vector<Particle>::iterator sliceStart, const std::vector<Particle>::iterator sliceEnd, bool hasGravity, bool hasXGravity)
+void Fluid::UpdatePositions(const std::size_t sliceStart, const std::size_t sliceEnd, bool hasGravity, bool hasXGravity)
 {
     const float tgravity  = (hasGravity ?  gravity : 0.f);
     const float txgravity = (hasXGravity? xgravity : 0.f);
+    const float viscosityMultiplier = (1.0f - (viscosity * timestepRatio));
     
-    for (std::vector<Particle>::iterator iter{sliceStart}; iter < sliceEnd; ++iter)
+    for (std::size_t ID{sliceStart}; ID < sliceEnd; ++ID)
     {
-        Particle& particle = *iter;
-        particle.ApplyViscosity(viscosity);
-        particle.velocity.y +=  tgravity*timestepRatio; // inlining gravity calc here
-        particle.velocity.x += txgravity*timestepRatio;
-        particle.ApplySpeedcap();
+        float& vx = particles.vx[ID];
+        float& vy = particles.vy[ID];
+        vx *= viscosityMultiplier;
+        vy *= viscosityMultiplier;
+        vy +=  tgravity*timestepRatio; // inlining gravity calc here
+        vx += txgravity*timestepRatio;
+        ApplySpeedcap(vx, vy);
         
-        sf::Vector2f nextPosition = particle.getPosition();
-        nextPosition.x += particle.velocity.x * timestepRatio;
-        nextPosition.y += particle.velocity.y * timestepRatio;
+        sf::Vector2f nextPosition = particles.Position(ID);
+        nextPosition.x += vx * timestepRatio;
+        nextPosition.y += vy * timestepRatio;
         
-        // TODO: refactor bounding-box checks into a seperate function
-        //  keeping all particles within bounding box
-        // we must not allow position == limit in this function;
-        // otherwise, when we look up the related cell, it'll index past the end of the cellmatrix
-        if (nextPosition.y > ADJ_BOXHEIGHT) {
-            nextPosition.y = BOXHEIGHT -(DEFAULTRADIUS*2.f);
-            particle.velocity.y *= (-1.0 + bounceDampening);
+        if (isPeriodic) {
+            nextPosition.x = WrapPeriodic(nextPosition.x, config.PeriodicWidth());
+            nextPosition.y = WrapPeriodic(nextPosition.y, config.PeriodicHeight());
         }
-        else if (nextPosition.y < 0) {
-            nextPosition.y = -1*nextPosition.y;
-            particle.velocity.y *= (-1.0 + bounceDampening);
-        }
-        
-        if (nextPosition.x > ADJ_BOXWIDTH) {
-            nextPosition.x = BOXWIDTH - (DEFAULTRADIUS*2.f);
-            particle.velocity.x *= (-1.0 + bounceDampening);
-        }
-        else if (nextPosition.x < 0) {
-            nextPosition.x = -1*nextPosition.x;
-            particle.velocity.x *= (-1.0 + bounceDampening);
+        else {
+            // TODO: refactor bounding-box checks into a seperate function
+            //  keeping all particles within bounding box
+            // we must not allow position == limit in this function;
+            // otherwise, when we look up the related cell, it'll index past the end of the cellmatrix
+            if (nextPosition.y > ADJ_BOXHEIGHT) {
+                nextPosition.y = config.boxHeight -(DEFAULTRADIUS*2.f);
+                vy *= (-1.0 + bounceDampening);
+            }
+            else if (nextPosition.y < 0) {
+                nextPosition.y = -1*nextPosition.y;
+                vy *= (-1.0 + bounceDampening);
+            }
+            
+            if (nextPosition.x > ADJ_BOXWIDTH) {
+                nextPosition.x = config.boxWidth - (DEFAULTRADIUS*2.f);
+                vx *= (-1.0 + bounceDampening);
+            }
+            else if (nextPosition.x < 0) {
+                nextPosition.x = -1*nextPosition.x;
+                vx *= (-1.0 + bounceDampening);
+            }
         }
         
         assert((nextPosition.x >= 0) && (nextPosition.y >= 0) && "negative nextPosition!");
-        assert((nextPosition.x <= BOXWIDTH) && (nextPosition.y <= BOXHEIGHT) && "OOB nextPosition!");
+        assert((nextPosition.x < config.PeriodicWidth()) && (nextPosition.y < config.PeriodicHeight()) && "OOB nextPosition!");
         
-        particle.setPosition(nextPosition);
+        particles.SetPosition(ID, nextPosition);
     }
     
     return;
@@ -279,33 +594,38 @@ void Fluid::UpdatePositions(const std::vector<Particle>::iterator sliceStart, co
 
 // static version
 void Fluid::UpdatePositions(
-    std::vector<Particle>::iterator sliceStart, std::vector<Particle>::iterator sliceEnd,
-    sf::Vector2f gravityForces, float viscosityMultiplier, float bounceDampening)
+    ParticleState& state, std::size_t sliceStart, std::size_t sliceEnd,
+    sf::Vector2f gravityForces, float viscosityMultiplier, float bounceDampening, bool isPeriodic)
 {
-    for (std::vector<Particle>::iterator iter{sliceStart}; iter!=sliceEnd; ++iter)
+    for (std::size_t ID{sliceStart}; ID < sliceEnd; ++ID)
     {
-        Particle& particle = *iter;
-        sf::Vector2f nextPosition { particle.getPosition() + (particle.velocity+=gravityForces) };
-        
-        // handling reflections
-        particle.velocity = sf::Vector2f {
-          ((nextPosition.x < 0.f) || (nextPosition.x > ADJ_BOXWIDTH ))?
-          -(particle.velocity.x*bounceDampening) : particle.velocity.x,
-          ((nextPosition.y < 0.f) || (nextPosition.y > ADJ_BOXHEIGHT))?
-          -(particle.velocity.y*bounceDampening) : particle.velocity.y,
-        };
+        float& vx = state.vx[ID];
+        float& vy = state.vy[ID];
+        vx += gravityForces.x;
+        vy += gravityForces.y;
+        float nextX = state.x[ID] + vx;
+        float nextY = state.y[ID] + vy;
         
-        nextPosition = sf::Vector2f {
-          {(nextPosition.x < 0.f)? -nextPosition.x :
-          ((nextPosition.x > ADJ_BOXWIDTH)? 
-          (BOXWIDTH - (DEFAULTRADIUS*2.f)): nextPosition.x)},
-          {(nextPosition.y < 0.f)? -nextPosition.y :
-          ((nextPosition.y > ADJ_BOXHEIGHT)? 
-          (BOXHEIGHT -(DEFAULTRADIUS*2.f)): nextPosition.y)},
-        };
+        if (isPeriodic) {
+            nextX = WrapPeriodic(nextX, config.PeriodicWidth());
+            nextY = WrapPeriodic(nextY, config.PeriodicHeight());
+        }
+        else {
+            // handling reflections
+            vx = ((nextX < 0.f) || (nextX > ADJ_BOXWIDTH ))? -(vx*bounceDampening) : vx;
+            vy = ((nextY < 0.f) || (nextY > ADJ_BOXHEIGHT))? -(vy*bounceDampening) : vy;
+            
+            nextX = (nextX < 0.f)? -nextX :
+              ((nextX > ADJ_BOXWIDTH)? (config.boxWidth - (DEFAULTRADIUS*2.f)): nextX);
+            nextY = (nextY < 0.f)? -nextY :
+              ((nextY > ADJ_BOXHEIGHT)? (config.boxHeight -(DEFAULTRADIUS*2.f)): nextY);
+        }
         
-        particle.velocity *= viscosityMultiplier; particle.ApplySpeedcap();
-        particle.setPosition(nextPosition);
+        vx *= viscosityMultiplier;
+        vy *= viscosityMultiplier;
+        ApplySpeedcap(vx, vy);
+        state.x[ID] = nextX;
+        state.y[ID] = nextY;
     }
     
     return;
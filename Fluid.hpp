@@ -10,6 +10,7 @@
 #include <SFML/System/Time.hpp>
 
 #include "Globals.hpp"
+#include "Particles.hpp"
 struct Gradient_T;
 
 
@@ -23,46 +24,47 @@ class Fluid
     static constexpr float speedcap_soft{100.f};
     static constexpr float speedcap_hard{200.f};
      bool isTurbulent{false};
+    bool isPeriodic{false}; // particles wrap around the edges instead of bouncing (Simulation::SetBoundary)
     
     friend class Simulation;
     friend class MainGUI;
     friend struct FluidParameters; //defined in MainGUI
+    friend class HeadlessRunner; // Headless.cpp
+    friend class Benchmark; // Benchmark.cpp
     
     static bool isParticleScalingPositive;
     static float gradient_thresholdLow;   // speed at which gradient begins to apply
     static float gradient_thresholdHigh;  // speed that caps out the gradient
     static Gradient_T* activeGradient;
     
-    class Particle : public sf::CircleShape
-    {
-        const unsigned int UUID;
-        unsigned int cellID{0};
-        sf::Vector2f velocity {0.0, 0.0};
-        
-        friend class Fluid;
-        friend class Simulation;
-        friend class MainGUI;
-        
-        public:
-        void UpdateColor(const bool useTransparency);
-        
-        Particle(const unsigned int ID, float radius=DEFAULTRADIUS, std::size_t pointcount=DEFAULTPOINTCOUNT) 
-        : Particle::CircleShape(radius, pointcount), UUID{ID}
-        {
-            const sf::Color defaultcolor (0x0888FFFF);
-            setFillColor(defaultcolor);
-        }
-        
-        float Distance(const Particle& rh) const; // unused
-        static float Distance(const Particle& lh, const Particle& rh); // unused
-        void ApplyViscosity(const float viscosity) { velocity *= (1.0f - (viscosity * timestepRatio)); } // ideally cell-density would be accounted for here
-        void ApplySpeedcap();
-    };
+    static void ApplySpeedcap(float& vx, float& vy);
     // calculates diffusion-force between particles within the same cell
-    static sf::Vector2f CalcLocalForce(const Particle& lh, const Particle& rh, float fdensity);
+    static sf::Vector2f CalcLocalForce(const ParticleState& state, const unsigned int lh, const unsigned int rh, float fdensity);
+    // batched version of CalcLocalForce (used by the simulation); one particle against a contiguous block of positions.
+    // returns the total force on the particle at (px,py), and subtracts each pair's force from fx/fy (the opposite reaction).
+    // 'scale' is fdensity*timestepRatio; 'overlapForce' is used for exactly-overlapping pairs.
+    // the cos^3 falloff is a polynomial approximation (max error ~7e-7), so results differ slightly from CalcLocalForce.
+    static sf::Vector2f AccumulatePairForces(const float px, const float py, const sf::Vector2f overlapForce,
+        const float* xs, const float* ys, float* fx, float* fy, const std::size_t count, const float scale);
+    // fast-math mode; AccumulatePairForces uses an interpolated lookup-table instead (see PrintForceTableAccuracy)
+    static bool useForceTable;
+    
+    ParticleState particles;
+    // positions before the latest substep; the renderer interpolates from these (see Simulation::Advance)
+    std::vector<float> previousX, previousY;
+    int columns{NUMCOLUMNS}, rows{NUMROWS}; // initial layout (and number) of particles (set by Initialize)
+    sf::Vector2f InitialPosition(const int column, const int row) const;
     
+    // FLUIDSIM_HEADLESS: compiled out for the batch-runner (no rendertexture, no vertices)
+    #ifndef FLUIDSIM_HEADLESS
     sf::RenderTexture particle_texture;
-    std::vector<Particle> particles;
+    // every particle is a textured quad; the whole fluid is submitted as a single draw-call
+    static constexpr unsigned int circleTextureSize{64}; // pixels; stretched over each quad (with smoothing)
+    sf::Texture circle_texture; // white circle, tinted by the vertex-colors
+    std::vector<sf::Vertex> vertices; // 4 per particle (sf::Quads), indexed by UUID*4
+    // color and size are derived from the particle's speed (through the active gradient)
+    static void UpdateQuad(sf::Vertex* quad, const sf::Vector2f position, const sf::Vector2f velocity, const bool useTransparency);
+    #endif
     
     public:
     static void SetActiveGradient(Gradient_T* gptr) { activeGradient = gptr; }
@@ -71,13 +73,13 @@ class Fluid
         return isParticleScalingPositive; 
     }
     
-    bool Initialize();
+    bool Initialize(const int columnCount=config.columns, const int rowCount=config.rows);
     void UpdatePositions();
-    // overload for ranges
-    void UpdatePositions(const std::vector<Particle>::iterator sliceStart, const std::vector<Particle>::iterator sliceEnd, bool hasGravity, bool hasXGravity);
+    // overload for ranges (of particle indecies)
+    void UpdatePositions(const std::size_t sliceStart, const std::size_t sliceEnd, bool hasGravity, bool hasXGravity);
     // static version
-    static void UpdatePositions(std::vector<Particle>::iterator sliceStart, std::vector<Particle>::iterator sliceEnd,
-        sf::Vector2f gravityForces, float viscosityMultiplier, float bounceDampeningFactor);
+    static void UpdatePositions(ParticleState& state, std::size_t sliceStart, std::size_t sliceEnd,
+        sf::Vector2f gravityForces, float viscosityMultiplier, float bounceDampeningFactor, bool isPeriodic);
     
     // feed to UpdatePositions (static-version)
     struct CertainConstants {
@@ -95,28 +97,28 @@ class Fluid
     
     void Freeze() // sets all velocities to 0
     {
-        for (Particle& particle: particles) {
-            particle.velocity = {0,0};
-            particle.UpdateColor(false); // even if transparency is enabled, non-moving particles should be opaque
+        for (std::size_t ID{0}; ID < particles.size(); ++ID) {
+            particles.SetVelocity(ID, {0,0});
         }
     }
     
+    #ifndef FLUIDSIM_HEADLESS
     sf::Sprite GetSprite() { return sf::Sprite(particle_texture.getTexture()); }
-    void Redraw(const bool useTransparency, const bool shouldClear) 
-    {
-        if(shouldClear) particle_texture.clear(sf::Color::Transparent);
-        for (Particle& particle: particles) {
-            particle.UpdateColor(useTransparency);
-            particle_texture.draw(particle);
-        }
-        particle_texture.display();
+    // 'interpolation' is the fraction of the way from the previous positions to the current ones (1.0 draws the current)
+    void Redraw(const bool useTransparency, const bool shouldClear, const float interpolation=1.0f) {
+        Redraw(particles, useTransparency, shouldClear, interpolation);
     }
+    // draws some other copy of the particles instead (the simulation-thread's snapshots)
+    void Redraw(const ParticleState& state, const bool useTransparency, const bool shouldClear, const float interpolation=1.0f);
+    #endif
     
+    void SavePreviousPositions() { previousX = particles.x; previousY = particles.y; }
     void Reset();
 };
 
 
 void PrintSpeedcapInfo();
+void PrintForceTableAccuracy(); // error of the pair-force approximations vs. the exact formula (for picking a table-size)
 
 
 #endif
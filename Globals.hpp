@@ -1,22 +1,50 @@
 #ifndef FLUIDSIM_GLOBALS_HPP_INCLUDED
 #define FLUIDSIM_GLOBALS_HPP_INCLUDED
 
+#include <string>
 
-constexpr int NUMCOLUMNS{64}, NUMROWS{64}; // layout (and number) of particles spawned during init
-constexpr int BOXWIDTH{1000}, BOXHEIGHT{1000}; // internal resolution (default window resolution should match)
+
+constexpr int NUMCOLUMNS{64}, NUMROWS{64}; // default layout (and number) of particles spawned during init (see SimulationConfig)
+constexpr int BOXWIDTH{1000}, BOXHEIGHT{1000}; // default internal resolution (default window resolution should match)
 //constexpr float DEFAULTRADIUS {float(BOXWIDTH/NUMCOLUMNS) / 2.0f};
-constexpr float DEFAULTRADIUS {10.f}; // size of particles (sf::CircleShape)
-constexpr int DEFAULTPOINTCOUNT {16}; // number of points used to draw each circle (particles)
+constexpr float DEFAULTRADIUS {10.f}; // size of particles (unscaled; the rendered quads are twice this wide)
 constexpr unsigned int SPATIAL_RESOLUTION{20}; // units/pixels per grid-cell for calculating diffusion/collision
 
 static_assert((NUMCOLUMNS > 0) && (NUMROWS > 0), "Columns and Rows must be greater than 0");
 
 
 // diffusion stuff
-constexpr int radialdist_limit{5}; // highest radial_distance implemented by GetNeighbors
+constexpr int radialdist_limit{5}; // largest radial_distance for the mouse and GetNeighbors (stencils are generated for any radius)
+                                   // note: also scales the falloff-distance of the pair-forces (CalcLocalForce)
 constexpr int DIFFUSION_RADIUS{5}; // range in orthogonal-distance (grid-cells) used for diffusion/density calculations
                                    // (radius of 0 means only current cell is considered)
 static_assert((DIFFUSION_RADIUS <= radialdist_limit), "Diffusion-radius is too big");
+constexpr int diffusionrange_limit{64}; // largest range of the density-gradient alone (set at runtime; see DiffusionField::SetDiffusionRange)
+                                        // small grids limit it further (DiffusionField::MaxDiffusionRange)
+
+
+// problem-size chosen at startup (command-line or config-file); defaults are the constants above.
+// must be set before any Simulation is initialized (it sizes the particles, the cell-grid, and the cellIndex).
+// SPATIAL_RESOLUTION and DIFFUSION_RADIUS stay compile-time; the stencils and pair-force kernel are specialized on them.
+struct SimulationConfig
+{
+    int columns{NUMCOLUMNS}, rows{NUMROWS}; // layout (and number) of particles
+    int boxWidth{BOXWIDTH}, boxHeight{BOXHEIGHT}; // size of the domain (and the main window)
+    
+    // size of the domain in periodic-mode (particles wrap around at these); rounded up to whole grid-cells,
+    // so that the wrapped neighbor-cells line up with the wrapped particles
+    int PeriodicWidth()  const { return int((boxWidth  + SPATIAL_RESOLUTION-1) / SPATIAL_RESOLUTION * SPATIAL_RESOLUTION); }
+    int PeriodicHeight() const { return int((boxHeight + SPATIAL_RESOLUTION-1) / SPATIAL_RESOLUTION * SPATIAL_RESOLUTION); }
+    
+    // keys are the same on the command-line ('--width=N') and in config-files ('width = N');
+    // returns false for unrecognized keys, throws (std::stoi) for invalid values
+    bool Set(const std::string& key, const std::string& value);
+    bool LoadFile(const std::string& filename); // one 'key = value' per line; '#' starts a comment
+    bool Validate() const; // prints the reason when it fails
+    void Print() const;
+};
+
+extern SimulationConfig config; // Config.cpp
 
 
 // main.cpp
@@ -0,0 +1,244 @@
+// Headless batch-runner: steps the Simulation for a fixed number of steps, without any windows or rendertextures.
+// Built by the 'fluidsim_headless' target; every object-file is compiled with FLUIDSIM_HEADLESS,
+// which compiles out the textures/shapes in Fluid, DiffusionField and Simulation.
+#ifndef FLUIDSIM_HEADLESS
+#error "Headless.cpp requires FLUIDSIM_HEADLESS (build with 'make fluidsim_headless')"
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <numeric>
+
+#include "Simulation.hpp"
+
+
+// normally defined in Main.cpp
+float timestepRatio{1.0f};
+float timestepMultiplier{1.0f};
+const int framerateCap{0};
+
+
+void PrintHeadlessUsage()
+{
+    std::cout << "usage: fluidsim_headless [options]\n"
+        << "  --steps=N          number of updates to run (default: 1000)\n"
+        << "  --columns=N        initial particle layout (default: " << NUMCOLUMNS << ")\n"
+        << "  --rows=N           (particle count is columns*rows; default: " << NUMROWS << ")\n"
+        << "  --width=N          size of the domain (default: " << BOXWIDTH << ")\n"
+        << "  --height=N         (default: " << BOXHEIGHT << ")\n"
+        << "  --config=FILE      'key = value' lines for any of the four above (applied in order with the arguments)\n"
+        << "  --threads=N        thread-pool size (default: hardware_concurrency)\n"
+        << "  --timestep=X       fixed timestepRatio (default: 1.0)\n"
+        << "  --deterministic    seeded RNG and static scheduling\n"
+        << "  --seed=N           implies --deterministic\n"
+        << "  --gravity --xgravity --turbulent --new-method\n"
+        << "  --force-table      fast-math pair-forces (interpolated lookup-table)\n"
+        << "  --boundary=MODE    ghost-cells of the density-grid: none, empty, reflective, periodic (default: none)\n"
+        << "  --diffusion-range=N\n"
+        << "                     range of the density-gradient, 1-" << diffusionrange_limit << "; limited by the grid-size (default: " << DIFFUSION_RADIUS << ")\n"
+        << "  --diffusion-method=M\n"
+        << "                     auto, direct, fft (default: auto; picks per-axis by range and grid-size)\n"
+        << "  --<param>=X        gravity-strength, xgravity-strength, viscosity, fdensity, bounce-dampening,\n"
+        << "                     momentum-transfer, momentum-distribution\n"
+        << "  --output=PREFIX    writes PREFIX_timings.csv and PREFIX_particles.csv (default: headless)\n"
+        << "  --snapshot-every=N also writes PREFIX_particles_STEP.csv every N steps (default: 0/off)\n";
+}
+
+
+class HeadlessRunner
+{
+    Simulation simulation{};
+
+    int steps {1000};
+    unsigned int threads {0};
+    float timestep {1.0f};
+    bool useDeterministic {false};
+    std::uint64_t seed {0};
+    bool useGravity {false}, useXGravity {false}, useTurbulence {false}, useNewMethod {false};
+    DiffusionField::Boundary boundary {DiffusionField::Boundary::None};
+    int diffusionRange {DIFFUSION_RADIUS};
+    DiffusionField::DiffusionMethod diffusionMethod {DiffusionField::DiffusionMethod::Auto};
+    std::map<std::string, float> parameters; // applied after initialization
+    std::string outputPrefix {"headless"};
+    int snapshotInterval {0};
+
+    bool WriteParticles(const std::string& filename) const;
+    bool WriteTimings(const std::string& filename, const std::vector<double>& timings) const;
+
+    public:
+    bool ParseArgs(int argc, char** argv);
+    int Run();
+};
+
+
+bool HeadlessRunner::ParseArgs(int argc, char** argv)
+{
+    for (int C{1}; C < argc; ++C)
+    {
+        const std::string arg {argv[C]};
+        const std::size_t split = arg.find('=');
+        const std::string key   = arg.substr(0, split);
+        const std::string value = (split == std::string::npos)? "" : arg.substr(split+1);
+
+        try {
+            if      (key == "--steps")          { steps = std::stoi(value); }
+            else if (key == "--config")         { if (!config.LoadFile(value)) return false; }
+            else if (key == "--threads")        { threads = std::stoul(value); }
+            else if (key == "--timestep")       { timestep = std::stof(value); }
+            else if (key == "--deterministic")  { useDeterministic = true; }
+            else if (key == "--seed")           { useDeterministic = true; seed = std::stoull(value); }
+            else if (key == "--gravity")        { useGravity = true; }
+            else if (key == "--xgravity")       { useXGravity = true; }
+            else if (key == "--turbulent")      { useTurbulence = true; }
+            else if (key == "--new-method")     { useNewMethod = true; }
+            else if (key == "--force-table")    { Fluid::useForceTable = true; }
+            else if (key == "--boundary") {
+                const std::map<std::string, DiffusionField::Boundary> modes {
+                    {"none", DiffusionField::Boundary::None}, {"empty", DiffusionField::Boundary::Empty},
+                    {"reflective", DiffusionField::Boundary::Reflective}, {"periodic", DiffusionField::Boundary::Periodic},
+                };
+                boundary = modes.at(value); // throws (invalid value) for unknown modes
+            }
+            else if (key == "--diffusion-range") { diffusionRange = std::stoi(value); }
+            else if (key == "--diffusion-method") {
+                const std::map<std::string, DiffusionField::DiffusionMethod> methods {
+                    {"auto", DiffusionField::DiffusionMethod::Auto}, {"direct", DiffusionField::DiffusionMethod::Direct},
+                    {"fft", DiffusionField::DiffusionMethod::FFT},
+                };
+                diffusionMethod = methods.at(value);
+            }
+            else if (key == "--output")         { outputPrefix = value; }
+            else if (key == "--snapshot-every") { snapshotInterval = std::stoi(value); }
+            else if ((key == "--help") || (key == "-h")) { PrintHeadlessUsage(); return false; }
+            else if (key.starts_with("--") && config.Set(key.substr(2), value)) { ; } // columns, rows, width, height
+            else if (key.starts_with("--") && !value.empty()) { parameters[key.substr(2)] = std::stof(value); }
+            else { std::cerr << "unrecognized argument: " << arg << '\n'; PrintHeadlessUsage(); return false; }
+        } catch (const std::exception&) {
+            std::cerr << "invalid value for " << key << ": '" << value << "'\n";
+            return false;
+        }
+    }
+
+    if (steps <= 0) { std::cerr << "steps must be positive\n"; return false; }
+    if (!config.Validate()) { return false; }
+    return true;
+}
+
+
+bool HeadlessRunner::WriteParticles(const std::string& filename) const
+{
+    std::ofstream file(filename);
+    if (!file) { std::cerr << "failed to open: " << filename << '\n'; return false; }
+
+    const ParticleState& particles = simulation.fluid.particles;
+    file << "id,x,y,vx,vy,cell\n";
+    file.precision(9); // enough to round-trip a float (for comparing deterministic runs)
+    for (std::size_t ID{0}; ID < particles.size(); ++ID) {
+        file << ID << ',' << particles.x[ID] << ',' << particles.y[ID] << ','
+             << particles.vx[ID] << ',' << particles.vy[ID] << ',' << particles.cellID[ID] << '\n';
+    }
+    return true;
+}
+
+
+bool HeadlessRunner::WriteTimings(const std::string& filename, const std::vector<double>& timings) const
+{
+    std::ofstream file(filename);
+    if (!file) { std::cerr << "failed to open: " << filename << '\n'; return false; }
+
+    file << "step,ms\n";
+    for (std::size_t step{0}; step < timings.size(); ++step) {
+        file << step << ',' << timings[step] << '\n';
+    }
+    return true;
+}
+
+
+int HeadlessRunner::Run()
+{
+    if (threads > 0) { simulation.threadPool.Resize(threads); }
+    if (!simulation.Initialize(config.columns, config.rows)) {
+        std::cerr << "simulation failed to initialize! exiting.\n";
+        return 1;
+    }
+
+    // named parameters
+    const std::map<std::string, float*> parameterTable {
+        {"gravity-strength",      &simulation.fluid.gravity},
+        {"xgravity-strength",     &simulation.fluid.xgravity},
+        {"viscosity",             &simulation.fluid.viscosity},
+        {"fdensity",              &simulation.fluid.fdensity},
+        {"bounce-dampening",      &simulation.fluid.bounceDampening},
+        {"momentum-transfer",     &simulation.momentumTransfer},
+        {"momentum-distribution", &simulation.momentumDistribution},
+    };
+    for (const auto& [name, value]: parameters) {
+        if (!parameterTable.contains(name)) { std::cerr << "unknown parameter: " << name << '\n'; return 2; }
+        *parameterTable.at(name) = value;
+    }
+
+    simulation.hasGravity  = useGravity;
+    simulation.hasXGravity = useXGravity;
+    simulation.useOldmethod = !useNewMethod;
+    if (useTurbulence) { simulation.ToggleTurbulence(); }
+    simulation.SetBoundary(boundary);
+    simulation.diffusionField.SetDiffusionMethod(diffusionMethod);
+    simulation.diffusionField.SetDiffusionRange(diffusionRange);
+    if (simulation.diffusionField.GetDiffusionRange() != diffusionRange) {
+        std::cerr << "diffusion-range clamped to " << simulation.diffusionField.GetDiffusionRange()
+                  << " (at most (cells-1)/2 along the smaller axis, up to " << diffusionrange_limit << ")\n";
+    }
+    if (useDeterministic) { simulation.SetDeterministic(true, seed); }
+    simulation.deterministicTimestep = timestep;
+    timestepRatio = timestep * timestepMultiplier; // there's no frametime to measure
+
+    std::cout << "running " << steps << " steps with " << simulation.fluid.particles.size() << " particles on "
+              << simulation.threadPool.Size() << " threads" << (useDeterministic? " (deterministic)" : "") << '\n';
+
+    std::vector<double> timings;
+    timings.reserve(steps);
+    for (int step{0}; step < steps; ++step)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        simulation.Update();
+        const auto end = std::chrono::steady_clock::now();
+        timings.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+
+        if ((snapshotInterval > 0) && (((step+1) % snapshotInterval) == 0)) {
+            WriteParticles(outputPrefix + "_particles_" + std::to_string(step+1) + ".csv");
+        }
+    }
+
+    if (!WriteTimings(outputPrefix + "_timings.csv", timings)) { return 3; }
+    if (!WriteParticles(outputPrefix + "_particles.csv")) { return 3; }
+
+    if (!timings.empty())
+    {
+        std::vector<double> sorted{timings};
+        std::sort(sorted.begin(), sorted.end());
+        const double total = std::accumulate(sorted.begin(), sorted.end(), 0.0);
+        std::cout << "total: " << total << "ms"
+                  << " | mean: " << total / sorted.size() << "ms"
+                  << " | median: " << sorted[sorted.size()/2] << "ms"
+                  << " | p95: " << sorted[(sorted.size()*95)/100] << "ms"
+                  << " | max: " << sorted.back() << "ms\n";
+        std::cout << "ns/particle/step: " << (total * 1e6) / (double(sorted.size()) * simulation.fluid.particles.size()) << '\n';
+    }
+
+    PrintSpeedcapInfo();
+    return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+    std::cout << "~FLUIDSIM~ (headless)\n";
+    HeadlessRunner runner{};
+    if (!runner.ParseArgs(argc, argv)) { return 4; }
+    return runner.Run();
+}
@@ -14,6 +14,7 @@
 #include "Threading.hpp"
 #include "Shader.hpp"
 #include "MainGUI.hpp"
+#include "Profiler.hpp"
 
 
 float timestepRatio{1.0f}; // normalizing timesteps to make physics independent of frame-rate
@@ -54,8 +55,8 @@ void PrintProgramConfiguration()
     
     //std::cout << "\n--Program Configuration--\n";
     std::cout << '\n';
-    PRINTTWO(NUMCOLUMNS, NUMROWS);
-    PRINTTWO(BOXWIDTH, BOXHEIGHT);
+    PRINTTWO(config.columns, config.rows);
+    PRINTTWO(config.boxWidth, config.boxHeight);
     PRINT(SPATIAL_RESOLUTION);
     PRINT(DIFFUSION_RADIUS);
     
@@ -81,10 +82,35 @@ int main(int argc, char** argv)
     assert(IMGUI_CHECKVERSION() && "ImGui version-check failed!");
     std::cout << "using imgui v" << IMGUI_VERSION << '\n';
     
+    // deterministic-mode: '--deterministic' or '--seed=N' (implies deterministic)
+    // problem-size: '--config=FILE', '--columns=N', '--rows=N', '--width=N', '--height=N' (applied in order)
+    // threading: '--synchronous' steps the simulation inside the frameloop (instead of on it's own thread);
+    //  '--unthrottled' lets the simulation-thread step as fast as it can, rather than in real-time
+    bool useDeterministic {false};
+    bool useSimulationThread {true};
+    bool useUnthrottled {false};
+    std::uint64_t deterministicSeed {0};
     for (int C{0}; C < argc; ++C) {
         std::string arg {argv[C]};
         std::cout << "C: " << C << " \t arg: " << arg << '\n';
+        const std::size_t split = arg.find('=');
+        const std::string key   = arg.substr(0, split);
+        const std::string value = (split == std::string::npos)? "" : arg.substr(split+1);
+        // std::stoull/stoi throw for invalid values
+        try {
+            if (arg == "--deterministic") { useDeterministic = true; }
+            else if (key == "--seed") { useDeterministic = true; deterministicSeed = std::stoull(value); }
+            else if (arg == "--synchronous") { useSimulationThread = false; }
+            else if (arg == "--unthrottled") { useUnthrottled = true; }
+            else if (key == "--config") { if (!config.LoadFile(value)) return 1; }
+            else if (arg.starts_with("--") && config.Set(key.substr(2), value)) { ; } // columns, rows, width, height
+            else if (C > 0) { std::cerr << "unrecognized argument: " << arg << '\n'; return 1; } // argv[0] is the program
+        } catch (const std::exception&) {
+            std::cerr << "invalid value for " << key << ": '" << value << "'\n";
+            return 1;
+        }
     }
+    if (!config.Validate()) { return 1; }
     
     PrintProgramConfiguration();
     
@@ -103,7 +129,7 @@ int main(int argc, char** argv)
     
     // Title-bar is implied (for Style::Close)
     constexpr auto mainstyle = sf::Style::Close;  // disabling resizing
-    sf::RenderWindow mainwindow (sf::VideoMode(BOXWIDTH, BOXHEIGHT), "FLUIDSIM", mainstyle);
+    sf::RenderWindow mainwindow (sf::VideoMode(config.boxWidth, config.boxHeight), "FLUIDSIM", mainstyle);
     mainwindow.setPosition({2600, 0}); // move to right monitor
     mainwindow.setFramerateLimit(framerateCap);
     mainwindow.setVerticalSyncEnabled(usingVsync);
@@ -125,6 +151,10 @@ int main(int argc, char** argv)
         std::cerr << "simulation failed to initialize! exiting.\n";
         return 1;
     }
+    if (useDeterministic) {
+        simulation.SetDeterministic(true, deterministicSeed);
+        std::cout << "deterministic-mode enabled (seed: " << deterministicSeed << ")\n";
+    }
     
     Mouse_T mouse(mainwindow, simulation.GetDiffusionFieldPtr());
     auto&& [gridSprite, fluidSprite] = simulation.GetSprites();
@@ -159,10 +189,18 @@ int main(int argc, char** argv)
     
     PrintKeybinds();
     
+    // everything from here on that touches the simulation-state has to hold 'simulation.LockState()'
+    simulation.runUnthrottled = useUnthrottled;
+    if (useSimulationThread) {
+        simulation.StartThread();
+        std::cout << "simulation-thread started" << (useUnthrottled? " (unthrottled)\n" : "\n");
+    }
+    
     sf::Clock frametimer{};
     
     const auto HandleKeypress = [&](const sf::Keyboard::Key& keycode)
     {
+        const auto stateLock = simulation.LockState();
         const bool isShiftPressed {sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) || sf::Keyboard::isKeyPressed(sf::Keyboard::RShift)};
         switch (keycode)
         {
@@ -397,14 +435,17 @@ int main(int argc, char** argv)
                 
                 case sf::Event::MouseButtonPressed:
                     if((event.mouseButton.button==3)||(event.mouseButton.button==4)) // side-buttons
-                    { mouse.ClearPreservedOverlays(); break; } // manually handling this in case mouse isn't active
+                    { const auto stateLock = simulation.LockState(); mouse.ClearPreservedOverlays(); break; } // manually handling this in case mouse isn't active
                 [[fallthrough]];
                 case sf::Event::MouseMoved:
                 //case sf::Event::MouseLeft:
                 //case sf::Event::MouseEntered:
                 case sf::Event::MouseButtonReleased:
                 case sf::Event::MouseWheelScrolled:
+                {
+                    const auto stateLock = simulation.LockState();
                     mouse.HandleEvent(event);
+                }
                 break;
                 
                 case sf::Event::Resized:
@@ -412,7 +453,7 @@ int main(int argc, char** argv)
                     auto [newwidth, newheight] = event.size;
                     sf::View newview {mainwindow.getView()};
                     //newview.setSize(newwidth, newheight);
-                    newview.setViewport({0, 0, float{float(BOXWIDTH)/newwidth}, float{float(BOXHEIGHT)/newheight}});
+                    newview.setViewport({0, 0, float{float(config.boxWidth)/newwidth}, float{float(config.boxHeight)/newheight}});
                     mainwindow.setView(newview);
                     
                     /* auto newviewsize = mainwindow.getView().getSize();
@@ -436,7 +477,7 @@ int main(int argc, char** argv)
                 mainwindow.clear(sf::Color::Transparent); // always clear when paused so you can modify and observe the effects of the 'threshold' parameter
             
             if (mouse.isActive(true) && mouse.isPaintingMode) { 
-                mouse.RedrawOutlines();
+                { const auto stateLock = simulation.LockState(); mouse.RedrawOutlines(); }
                 mainwindow.draw(outlineOverlay);
                 hoverOutline.setFillColor({0x1A, 0xFF, 0x1A, 0x82});
                 mainwindow.draw(hoverOutline); 
@@ -444,22 +485,28 @@ int main(int argc, char** argv)
             else if (mouse.shouldOutline) { hoverOutline.setFillColor(sf::Color::Transparent); mainwindow.draw(hoverOutline); }
             if (mouse.shouldDisplay) { mainwindow.draw(mouse); }
             
-            simulation.Update();
+            if (simulation.IsThreaded()) simulation.AcquireSnapshot();
+            else simulation.Advance(timestepRatio);
             simulation.RedrawFluid(windowClearDisabled);
             mainwindow.draw(fluidSprite, Shader::current);
             
             // unlike the normal frameloop, here the mouse-outline is drawn even if the mouse is inactive;
             // without it, there's no visual indicator that the mouse is enabled, and no position.
             mainwindow.display();
-            timestepRatio = float(frametimer.getElapsedTime().asMicroseconds() * 0.00006667);
-            timestepRatio *= timestepMultiplier;
+            profiler.EndFrame(&simulation.threadPool);
+            if (!simulation.IsThreaded()) { // the simulation-thread keeps it's own time
+                timestepRatio = float(frametimer.getElapsedTime().asMicroseconds() * 0.00006667);
+                timestepRatio *= timestepMultiplier;
+            }
             continue;
         }
         
         
         if (!windowClearDisabled)
         mainwindow.clear(sf::Color::Transparent);
-        simulation.Update();
+        // threaded: just picks up the latest state that the simulation-thread finished (if there's a new one)
+        if (simulation.IsThreaded()) simulation.AcquireSnapshot();
+        else simulation.Advance(timestepRatio);
         
         if (shouldDrawGrid || (mouse.isPaintingMode && mouse.isPaintingDebug)) {
             simulation.RedrawGrid();
@@ -471,7 +518,7 @@ int main(int argc, char** argv)
         else if (mouse.isPaintingMode || mouse.isPaintingDebug) {
             if (mouse.isActive(true) || mouse.isPaintingDebug)
             {
-                mouse.RedrawOverlay();
+                { const auto stateLock = simulation.LockState(); mouse.RedrawOverlay(); }
                 mainwindow.draw(cellOverlay);
                 mouse.shouldOutline = true;
                 if (!mouse.isPaintingDebug)
@@ -484,17 +531,25 @@ int main(int argc, char** argv)
         
         simulation.RedrawFluid(!windowClearDisabled);
         mainwindow.draw(fluidSprite, Shader::current);
-        if (mouse.shouldOutline) { mouse.RedrawOutlines(); mainwindow.draw(outlineOverlay); }
+        if (mouse.shouldOutline) {
+            { const auto stateLock = simulation.LockState(); mouse.RedrawOutlines(); }
+            mainwindow.draw(outlineOverlay);
+        }
         if (mouse.shouldDisplay) { mainwindow.draw(mouse); }
         
         mainwindow.display();
+        profiler.EndFrame(&simulation.threadPool);
         
         // this is assuming 60FPS?
         //timestepRatio = float(frametimer.getElapsedTime().asMicroseconds() / 16666.66667);
-        timestepRatio = float(frametimer.getElapsedTime().asMicroseconds() * 0.00006667);
-        timestepRatio *= timestepMultiplier;
+        if (!simulation.IsThreaded()) {
+            timestepRatio = float(frametimer.getElapsedTime().asMicroseconds() * 0.00006667);
+            timestepRatio *= timestepMultiplier;
+        }
     }
     
+    simulation.StopThread();
+    
     ImGui::SFML::Shutdown();  // destroys ALL! contexts
     
     PrintSpeedcapInfo();
@@ -1,6 +1,7 @@
 #include "MainGUI.hpp"
 #include "Slider.hpp"
 #include "Shader.hpp" // turbulence_ptrs
+#include "Profiler.hpp"
 
 #include <iostream> // only used in MainGUI::Initialize()
 
@@ -404,6 +405,17 @@ float MainGUI::DrawSimulParams(float next_height)
     ImGui::SameLine();
     if(ImGui::Button("Reset##Timescale")) timestepMultiplier = 1.0f;
     
+    // fixed-timestep (Simulation::Advance); the physics run in substeps regardless of the framerate
+    Simulation& simulation = SimulParams->simulation;
+    ImGui::Checkbox("Fixed timestep", &simulation.useFixedTimestep);
+    static Slider slider_Substep {"##Substep", &simulation.fixedTimestep, 0.05f, 2.0f, "Substep: %.3f"};
+    slider_Substep();
+    ImGui::SameLine();
+    if(ImGui::Button("Reset##Substep")) simulation.fixedTimestep = 1.0f;
+    ImGui::SliderInt("Max substeps", &simulation.maxSubsteps, 1, 16);
+    // simulation-thread steps as fast as possible, instead of in real-time (the framerate paces it otherwise)
+    if (simulation.IsThreaded()) ImGui::Checkbox("Unthrottled", &simulation.runUnthrottled);
+    
     ImGui::SeparatorText("Momentum");
     
     #define PREFIX(fieldname) momentum##fieldname
@@ -421,6 +433,28 @@ float MainGUI::DrawSimulParams(float next_height)
     #undef PSTRUCT
     #undef PRECISION
     
+    ImGui::SeparatorText("Boundary");
+    // same order as DiffusionField::Boundary
+    static constexpr const char* boundaryNames[] {"None", "Empty", "Reflective", "Periodic"};
+    int boundaryIndex = int(SimulParams->simulation.diffusionField.GetBoundary());
+    if (ImGui::Combo("Ghost-cells", &boundaryIndex, boundaryNames, IM_ARRAYSIZE(boundaryNames))) {
+        SimulParams->simulation.SetBoundary(DiffusionField::Boundary(boundaryIndex));
+    }
+    
+    // range of the density-gradient; the longer ranges go through the FFT (per-axis, see DiffusionField::PreferFFT)
+    DiffusionField& diffusionField = SimulParams->simulation.diffusionField;
+    int diffusionRange = diffusionField.GetDiffusionRange();
+    if (ImGui::SliderInt("Diffusion range", &diffusionRange, 1, DiffusionField::MaxDiffusionRange(), "%d", ImGuiSliderFlags_AlwaysClamp)) {
+        diffusionField.SetDiffusionRange(diffusionRange);
+    }
+    // same order as DiffusionField::DiffusionMethod
+    static constexpr const char* methodNames[] {"Auto", "Direct", "FFT"};
+    int methodIndex = int(diffusionField.GetDiffusionMethod());
+    if (ImGui::Combo("Convolution", &methodIndex, methodNames, IM_ARRAYSIZE(methodNames))) {
+        diffusionField.SetDiffusionMethod(DiffusionField::DiffusionMethod(methodIndex));
+    }
+    ImGui::Text("using: %s", (diffusionField.UsesFFT()? "FFT" : "direct"));
+    
     next_height += ImGui::GetWindowHeight(); // 'GetWindowHeight' returns height of current section
     ImGui::End();
     return next_height;
@@ -485,6 +519,8 @@ float MainGUI::DrawFluidParams(float next_height)
     MAKESLIDER(fdensity);
     slider_fdensity.stepsizeMin = 0.000001f;
     slider_fdensity.stepsizeMax = 0.001f;
+    numlines += 1;
+    ImGui::Checkbox("Fast-math (pair-force lookup-table)", &Fluid::useForceTable);
     
     #undef  PRECISION
     #define PRECISION() "2"
@@ -676,12 +712,77 @@ float MainGUI::DrawTurbSection(float next_height)
 }
 
 
+// per-phase timings from the global profiler (Profiler.hpp); the plot shows the selected phase's history
+float MainGUI::DrawProfilerSection(float next_height)
+{
+    ImGui::Begin("Profiler", nullptr, subwindow_flags^ImGuiWindowFlags_NoTitleBar);
+    ImGui::SetWindowPos({0, next_height});
+    ImGui::SetWindowSize({m_width, -1});  // -1 retains current size
+    
+    ImGui::Checkbox("Enabled##Profiler", &profiler.isEnabled); ImGui::SameLine();
+    ImGui::Text("frametime: %.2fms", profiler.FrameTime());
+    
+    static int selectedPhase {Profiler::Integration};
+    if (ImGui::CollapsingHeader("Phases", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        ImGui::BeginDisabled(!profiler.isEnabled);
+        constexpr ImGuiTableFlags tableflags { ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_SizingStretchProp };
+        if (ImGui::BeginTable("ProfilerTable", 4, tableflags))
+        {
+            ImGui::TableSetupColumn("phase", ImGuiTableColumnFlags_WidthStretch, 2.f);
+            ImGui::TableSetupColumn("ms");
+            ImGui::TableSetupColumn("avg");
+            ImGui::TableSetupColumn("max");
+            ImGui::TableHeadersRow();
+            
+            for (int phase{0}; phase < Profiler::PhaseCount; ++phase)
+            {
+                const auto P = Profiler::Phase(phase);
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                // clicking a row selects the phase that gets plotted
+                if (ImGui::Selectable(Profiler::names[P], (selectedPhase == phase), ImGuiSelectableFlags_SpanAllColumns))
+                    selectedPhase = phase;
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", profiler.Latest(P));
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", profiler.Average(P));
+                ImGui::TableNextColumn(); ImGui::Text("%.3f", profiler.Max(P));
+            }
+            ImGui::EndTable();
+        }
+        
+        const auto P = Profiler::Phase(selectedPhase);
+        ImGui::PlotLines("##ProfilerHistory", profiler.History(P), Profiler::historyLength, profiler.HistoryOffset(),
+                         Profiler::names[P], 0.f, profiler.Max(P) * 1.1f, {m_width - 16.f, 60.f});
+        ImGui::EndDisabled();
+    }
+    
+    if (ImGui::CollapsingHeader("Thread utilization"))
+    {
+        // busy-time of each pool-thread, as a fraction of the frametime; the last entry is the main thread
+        const std::vector<float>& utilization = profiler.ThreadUtilization();
+        for (std::size_t index{0}; index < utilization.size(); ++index) {
+            const bool isMain = (index+1 == utilization.size());
+            const std::string overlay = (isMain? std::string{"main"} : std::to_string(index)) + ": "
+                                      + std::to_string(int(utilization[index] * 100.f)) + '%';
+            ImGui::ProgressBar(utilization[index], {-1.f, 0.f}, overlay.c_str());
+        }
+    }
+    
+    next_height += ImGui::GetWindowHeight();
+    ImGui::End();
+    return next_height;
+}
+
+
 void MainGUI::FrameLoop(std::vector<sf::Keyboard::Key>& unhandled_keypresses) 
 {
     if (!isEnabled || !isOpen()) { return; }
     if (dockedToMain) FollowMainWindow();
     
     sf::RenderWindow::setActive(); // possibly unnecessary?
+    // the widgets write straight into the simulation; so the simulation-thread has to wait until they're done (not including the display)
+    std::unique_lock<std::mutex> stateLock{};
+    if (SimulParams) { stateLock = SimulParams->simulation.LockState(); }
     HandleWindowEvents(unhandled_keypresses);
     ImGui::SFML::Update(*this, clock.restart());
     sf::RenderWindow::clear();
@@ -704,6 +805,7 @@ void MainGUI::FrameLoop(std::vector<sf::Keyboard::Key>& unhandled_keypresses)
     next_height = DrawFluidParams(next_height);
     next_height = DrawTurbSection(next_height);
     next_height = DrawMouseParams(next_height);
+    next_height = DrawProfilerSection(next_height);
     
     
     // Demo-Window Toggle Button
@@ -731,6 +833,7 @@ void MainGUI::FrameLoop(std::vector<sf::Keyboard::Key>& unhandled_keypresses)
         ImGui::SetWindowSize("Dear ImGui Demo", {m_width, m_height});  // using '-1' for height here disables resizing from edges, regardless of windowflags/IOflags
     }
     
+    if (stateLock) { stateLock.unlock(); }
     ImGui::SFML::Render(*this);
     sf::RenderWindow::display();
     return;
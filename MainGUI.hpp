@@ -17,7 +17,7 @@
 class MainGUI: sf::RenderWindow
 {
     float m_width  {345}; // ImVec2 (used by SetWindowSize/Position) only holds floats
-    float m_height {BOXHEIGHT};
+    float m_height {float(config.boxHeight)};
     bool showDemoWindow {false};
     sf::Clock clock; // ImGui::SFML::Update() needs deltatime
     
@@ -48,11 +48,13 @@ class MainGUI: sf::RenderWindow
         bool& hasXGravity;
         float& momentumTransfer;
         float& momentumDistribution;
+        Simulation& simulation; // SetBoundary
         SimulParameters(Simulation* simulation): realptr{simulation},
             hasGravity           {simulation->hasGravity},
             hasXGravity          {simulation->hasXGravity},
             momentumTransfer     {simulation->momentumTransfer},
-            momentumDistribution {simulation->momentumDistribution}
+            momentumDistribution {simulation->momentumDistribution},
+            simulation           {*simulation}
         { ; }
     };
     
@@ -82,6 +84,7 @@ class MainGUI: sf::RenderWindow
     float DrawSimulParams(float start_height);
     float DrawMouseParams(float start_height);
     float DrawTurbSection(float start_height);
+    float DrawProfilerSection(float start_height);
     
     
     // initializes a 'Parameter' struct and sets the corresponding 'Params' pointer (above)
@@ -1,4 +1,5 @@
 #include "Mouse.hpp"
+#include "Profiler.hpp"
 
 //#include <iostream>
 //#include <cassert>
@@ -12,6 +13,7 @@ sf::RectangleShape hoverOutline{sf::Vector2f{SPATIAL_RESOLUTION, SPATIAL_RESOLUT
 static std::vector<sf::Vector2f> outlined{};
 void Mouse_T::RedrawOutlines()
 {
+    const auto timer = profiler.Time(Profiler::MouseOverlay);
     outlineOverlay.clear(sf::Color::Transparent);
     
     sf::RectangleShape outline{sf::Vector2f{SPATIAL_RESOLUTION, SPATIAL_RESOLUTION}};
@@ -41,9 +43,10 @@ void Mouse_T::RedrawOutlines()
 struct CellState_T
 {
     std::size_t UUID;
-    Cell* const cellptr;
-    const Cell originalState;  // needed to restore the cell after moving or releasing-button
-    // saving the whole cell is overkill; only the modified/necessary components should be copied
+    DiffusionField* const fieldptr;
+    // needed to restore the cell after moving or releasing-button; only the parts of the cell's state that can change
+    const float originalDensity;
+    const sf::Vector2f originalMomentum;
     
     struct Mod_T // stores modifications applied by the mouse-mode
     {
@@ -54,10 +57,20 @@ struct CellState_T
         sf::RectangleShape overlay;
     } mod;
     
+    float& Density() const { return fieldptr->density[UUID]; }
+    
+    // writes back the original state (plus any external changes made to density)
+    void Restore(const float densityAdjustment) const {
+        Density() = originalDensity + densityAdjustment;
+        fieldptr->momentumX[UUID] = originalMomentum.x;
+        fieldptr->momentumY[UUID] = originalMomentum.y;
+    }
+    
     CellState_T(const CellState_T& other): 
     UUID {other.UUID},
-    cellptr {other.cellptr}, 
-    originalState {*other.cellptr},
+    fieldptr {other.fieldptr}, 
+    originalDensity {other.Density()},
+    originalMomentum {other.fieldptr->Momentum(other.UUID)},
     mod {other.mod}
     { 
         //mod.dist = ((mod.dist>other.mod.dist)? other.mod.dist : mod.dist);
@@ -66,16 +79,14 @@ struct CellState_T
         mod.overlay.setOutlineColor(other.mod.overlay.getOutlineColor());
     }
     
-    CellState_T(const std::size_t ID, Cell* const ptr): UUID{ID}, cellptr{ptr}, originalState{*ptr}
+    CellState_T(const std::size_t ID, DiffusionField* const ptr): UUID{ID}, fieldptr{ptr},
+    originalDensity{ptr->density[ID]}, originalMomentum{ptr->Momentum(ID)}
     {
-        mod.overlay = originalState; // Cell inherits from RectangleShape
+        mod.overlay = DiffusionField::CellShape(fieldptr->cells[ID]);
         //mod.overlay.setFillColor(sf::Color::Transparent);
         //mod.overlay.setOutlineColor(sf::Color::Transparent);
         
         // TODO: initialize mod here or in ModifyCell?
-        // example of pointer-to-member
-        /* float Cell::* mcptr = &Cell::density;
-        const float& epicmem = cellptr->*mcptr; */
     }
     
     /* ~CellState_T()
@@ -116,7 +127,7 @@ void Mouse_T::RecalculateModDensities() const
         };
         const float diffStrength = cellstate.mod.density - adjStrength;
         cellstate.mod.density = adjStrength;
-        cellstate.cellptr->density -= diffStrength;
+        cellstate.Density() -= diffStrength;
     }
     return;
 }
@@ -125,7 +136,7 @@ void Mouse_T::RecalculateModDensities() const
 // this can be const because savedstate / preservedOverlays are both static
 void Mouse_T::ClearPreservedOverlays() const { 
     for (auto& [id, state]: preservedOverlays) {
-        fieldptr->cells[id].density -= state.mod.density;
+        fieldptr->density[id] -= state.mod.density;
     }
     preservedOverlays.clear();
     return;
@@ -133,6 +144,7 @@ void Mouse_T::ClearPreservedOverlays() const {
 
 void Mouse_T::RedrawOverlay()
 {
+    const auto timer = profiler.Time(Profiler::MouseOverlay);
     cellOverlay.clear(sf::Color::Transparent);
     for (auto& [key, state]: savedState) {
         state.mod.overlay.setFillColor({sf::Color{sf::Color::Yellow.toInteger() - 0x64}});
@@ -151,7 +163,7 @@ auto Mouse_T::StoreCell(Cell* const cellptr)
 {
     const std::size_t ID = cellptr->UUID;
     if (savedState.contains(ID)) { return &savedState.at(ID); }
-    const auto result = savedState.emplace(ID, CellState_T(ID, cellptr));
+    const auto result = savedState.emplace(ID, CellState_T(ID, fieldptr));
     return &result.first->second;
 }
 
@@ -163,7 +175,7 @@ void Mouse_T::ModifyCell(const Cell* const cellptr)
     { 
         case None:
             if (!hoveredCell) { return; }
-            hoverOutline.setPosition(hoveredCell->getPosition());
+            hoverOutline.setPosition(hoveredCell->Position());
             shouldOutline = true;
         break;
         
@@ -172,13 +184,13 @@ void Mouse_T::ModifyCell(const Cell* const cellptr)
         {
             CellState_T& state = savedState.at(cellptr->UUID);
             state.mod.density = ((mode==Push)? strength : -strength);
-            state.cellptr->density += state.mod.density;
-            hoverOutline.setPosition(hoveredCell->getPosition());
+            state.Density() += state.mod.density;
+            hoverOutline.setPosition(hoveredCell->Position());
             if (isPaintingMode)
             {
                 hoverOutline.setFillColor({0x1A, 0xFF, 0x1A, 0x82});
                 outlined.clear();
-                outlined.push_back(hoveredCell->getPosition());
+                outlined.push_back(hoveredCell->Position());
             }
             for (int dist{1}; dist <= radialDist; ++dist)
             {
@@ -193,12 +205,12 @@ void Mouse_T::ModifyCell(const Cell* const cellptr)
                     // overwrite any painted areas, instead of merging them
                     if (preservedOverlays.contains(cellptr->UUID)) {
                         auto x = preservedOverlays.extract(cellptr->UUID);
-                        cellptr->density -= x.mapped().mod.density;
+                        fieldptr->density[cellptr->UUID] -= x.mapped().mod.density;
                     }
                     entry->mod.dist = dist;
                     entry->mod.density = adjStrength;
-                    cellptr->density += adjStrength;
-                    outlined.push_back(cellptr->getPosition());
+                    fieldptr->density[cellptr->UUID] += adjStrength;
+                    outlined.push_back(cellptr->Position());
                     // TODO: inline all of the 'outline' drawing code here?
                 }
             }
@@ -219,11 +231,10 @@ void Mouse_T::RestoreCell(const std::size_t cellID)
 {
     // CellState_T& state = shouldRemove? savedState.extract(cellID).mapped() : savedState.at(cellID);
     const CellState_T state = savedState.extract(cellID).mapped();
-    //state.cellptr->density -= state.mod.density;  // will be overwitten by originalState anyway
-    // colors/outlines are restored by the read from originalState
+    //state.Density() -= state.mod.density;  // will be overwitten by originalDensity anyway
     
     // accounting for any external changes made to density (not from Mouse) since it was stored
-    const float densityAdjustment = (state.cellptr->density - state.mod.density) - state.originalState.density;
+    const float densityAdjustment = (state.Density() - state.mod.density) - state.originalDensity;
     
     if (preservedOverlays.contains(cellID)) {
         auto& preserved = preservedOverlays.at(cellID);
@@ -231,8 +242,7 @@ void Mouse_T::RestoreCell(const std::size_t cellID)
         return;
     }
     
-    *state.cellptr = state.originalState;
-    state.cellptr->density += densityAdjustment;
+    state.Restore(densityAdjustment);
     
     return;
 }
@@ -251,7 +261,7 @@ void Mouse_T::InvalidateHover(bool preserve)
     for (const auto id: ids)
     {
         const CellState_T state = savedState.extract(id).mapped();
-        const float densityAdjustment = (state.cellptr->density - state.mod.density) - state.originalState.density;
+        const float densityAdjustment = (state.Density() - state.mod.density) - state.originalDensity;
         
         if (preserve) {
             if (preservedOverlays.contains(id)) {
@@ -262,8 +272,7 @@ void Mouse_T::InvalidateHover(bool preserve)
             continue;
         }
         
-        *state.cellptr = state.originalState;
-        state.cellptr->density += densityAdjustment;
+        state.Restore(densityAdjustment);
     }
     
     shouldDisplay = false;
@@ -298,7 +307,7 @@ void Mouse_T::SwitchMode(const Mode nextmode)
             hoverOutline.setFillColor(sf::Color::Transparent);
             // just drawing hoveredCell's outline
             if (UpdateHovered()) {
-                hoverOutline.setPosition(hoveredCell->getPosition());
+                hoverOutline.setPosition(hoveredCell->Position());
                 shouldOutline = true;
                 shouldDisplay = false;
             }
@@ -337,7 +346,7 @@ bool Mouse_T::UpdateHovered()
     setPosition(x, y); // moving the sf::CircleShape
     if (hoveredCell) // checking if we're still hovering the same cell
     {
-        if (hoveredCell->getGlobalBounds().contains(x, y))
+        if (hoveredCell->Bounds().contains(x, y))
         { // still inside oldcell
             if (!savedState.contains(hoveredCell->UUID))
                 StoreCell(hoveredCell);
@@ -0,0 +1,100 @@
+#ifndef FLUIDSIM_PARTICLES_HPP_INCLUDED
+#define FLUIDSIM_PARTICLES_HPP_INCLUDED
+
+#include <vector>
+#include <span>
+#include <cstddef> // size_t
+
+#include <SFML/System/Vector2.hpp>
+
+
+// Simulation-state of every particle, stored as parallel arrays (structure-of-arrays).
+// The index into each array is the particle's UUID.
+// The hot loops only need positions/velocities, so they shouldn't have to drag
+// the rendering-state through the cache; that lives in Fluid::vertices instead.
+struct ParticleState
+{
+    std::vector<float> x, y;    // position (top-left corner of the particle's shape)
+    std::vector<float> vx, vy;  // velocity
+    std::vector<unsigned int> cellID;
+
+    std::size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+
+    void resize(const std::size_t count)
+    {
+        x.resize(count, 0.f);  y.resize(count, 0.f);
+        vx.resize(count, 0.f); vy.resize(count, 0.f);
+        cellID.resize(count, 0);
+    }
+
+    void reserve(const std::size_t count)
+    {
+        x.reserve(count);  y.reserve(count);
+        vx.reserve(count); vy.reserve(count);
+        cellID.reserve(count);
+    }
+
+    sf::Vector2f Position(const std::size_t ID) const { return {x[ID], y[ID]}; }
+    sf::Vector2f Velocity(const std::size_t ID) const { return {vx[ID], vy[ID]}; }
+    void SetPosition(const std::size_t ID, const sf::Vector2f position) { x[ID] = position.x; y[ID] = position.y; }
+    void SetVelocity(const std::size_t ID, const sf::Vector2f velocity) { vx[ID] = velocity.x; vy[ID] = velocity.y; }
+    void AddVelocity(const std::size_t ID, const sf::Vector2f delta) { vx[ID] += delta.x; vy[ID] += delta.y; }
+};
+
+
+// Velocity-deltas accumulated privately by one thread, and applied to the ParticleState afterwards.
+// Pair-forces also act on particles of cells being processed by other threads;
+// giving each thread its own buffer avoids both the data-race and false-sharing on ParticleState.
+struct VelocityBuffer
+{
+    std::vector<float> dvx, dvy;
+
+    void resize(const std::size_t count) { dvx.resize(count, 0.f); dvy.resize(count, 0.f); }
+    void Add(const std::size_t ID, const sf::Vector2f delta) { dvx[ID] += delta.x; dvy[ID] += delta.y; }
+
+    // adds the buffered deltas in [start, end) to the state and zeroes them (ready for the next step)
+    void ApplyAndClear(ParticleState& state, const std::size_t start, const std::size_t end)
+    {
+        for (std::size_t ID{start}; ID < end; ++ID) {
+            state.vx[ID] += dvx[ID]; dvx[ID] = 0.f;
+            state.vy[ID] += dvy[ID]; dvy[ID] = 0.f;
+        }
+    }
+};
+
+
+// Positions of a group of particles gathered into contiguous arrays (for Fluid::AccumulatePairForces),
+// along with the forces accumulated on each of them; scattered into a VelocityBuffer once the group is done.
+struct PairBlock
+{
+    std::vector<unsigned int> IDs;
+    std::vector<float> x, y;
+    std::vector<float> fx, fy;
+
+    std::size_t size() const { return IDs.size(); }
+    void clear() { IDs.clear(); x.clear(); y.clear(); fx.clear(); fy.clear(); }
+
+    // appends the particles to the block (forces start at zero)
+    // 'shift' is added to the positions; in periodic-mode, it moves particles from across the edge next to the origin
+    void Gather(const ParticleState& state, const std::span<const unsigned int> particleset, const sf::Vector2f shift={0.f, 0.f})
+    {
+        for (const unsigned int ID: particleset) {
+            IDs.push_back(ID);
+            x.push_back(state.x[ID] + shift.x);
+            y.push_back(state.y[ID] + shift.y);
+        }
+        fx.resize(IDs.size(), 0.f);
+        fy.resize(IDs.size(), 0.f);
+    }
+
+    void Scatter(VelocityBuffer& forces) const
+    {
+        for (std::size_t index{0}; index < IDs.size(); ++index) {
+            forces.Add(IDs[index], {fx[index], fy[index]});
+        }
+    }
+};
+
+
+#endif
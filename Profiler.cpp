@@ -0,0 +1,50 @@
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+
+Profiler profiler{};
+
+
+void Profiler::EndFrame(ThreadPool* threadPool)
+{
+    const Clock::time_point now = Clock::now();
+    frametime = std::chrono::duration<float, std::milli>(now - lastFrame).count();
+    lastFrame = now;
+    if (!isEnabled) { return; }
+
+    for (std::size_t phase{0}; phase < PhaseCount; ++phase) {
+        history[phase][head] = current[phase].exchange(0.f);
+    }
+    head = (head + 1) % historyLength;
+    recorded = std::min(recorded + 1, historyLength);
+
+    if (threadPool && (frametime > 0.f))
+    {
+        threadPool->CollectBusyTime(busytime);
+        utilization.resize(busytime.size(), 0.f);
+        // exponential smoothing; the raw per-frame value is too noisy to read
+        constexpr float smoothing {0.1f};
+        for (std::size_t index{0}; index < busytime.size(); ++index) {
+            const float sample = std::min(float(busytime[index]) / frametime, 1.f);
+            utilization[index] += (sample - utilization[index]) * smoothing;
+        }
+    }
+    return;
+}
+
+
+float Profiler::Average(const Phase phase) const
+{
+    if (recorded == 0) { return 0.f; }
+    // unrecorded entries are zero, so summing the whole ring is fine
+    return std::accumulate(history[phase].begin(), history[phase].end(), 0.f) / float(recorded);
+}
+
+
+float Profiler::Max(const Phase phase) const
+{
+    return *std::max_element(history[phase].begin(), history[phase].end());
+}
@@ -0,0 +1,89 @@
+#ifndef FLUIDSIM_PROFILER_HPP_INCLUDED
+#define FLUIDSIM_PROFILER_HPP_INCLUDED
+
+#include <array>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <cstddef> // size_t
+
+class ThreadPool;
+
+
+// Per-phase frame-timings with a rolling history (for MainGUI).
+// Every phase is timed on the thread driving the frame, around whole ParallelFor calls,
+// so parallel phases report wall-time and each timer costs two clock-reads per frame.
+// With the simulation-thread (Simulation::StartThread), the simulation-phases accumulate into whichever
+// render-frame they finished during; the render-thread is still the only one calling EndFrame.
+class Profiler
+{
+    public:
+    enum Phase {
+        Integration,          // Fluid::UpdatePositions
+        TransitionDetection,  // FindCellTransitions
+        TransitionSort,       // TransitionBuckets::Sort
+        TransitionHandling,   // HandleTransitions and rebuilding the cellIndex
+        Diffusion,            // pair-forces (Local/NonLocalDiffusion) and the velocity-buffer reduction
+        MomentumDistribution, // per-cell diffusionVec and momentum distributed to particles
+        FluidRedraw,
+        GridRedraw,
+        MouseOverlay,         // Mouse_T::RedrawOverlay/RedrawOutlines
+        PhaseCount
+    };
+    static constexpr std::array<const char*, PhaseCount> names {
+        "Integration", "Transition-detect", "Transition-sort", "Transition-handle",
+        "Diffusion", "Momentum-distrib", "Fluid redraw", "Grid redraw", "Mouse overlay",
+    };
+    static constexpr std::size_t historyLength {240}; // frames
+    using Clock = std::chrono::steady_clock;
+
+    // RAII timer; a phase may be entered multiple times per frame (the durations accumulate)
+    class ScopedTimer
+    {
+        Profiler& profiler;
+        const Phase phase;
+        const Clock::time_point start;
+
+        public:
+        ScopedTimer(Profiler& profiler, const Phase phase)
+        : profiler{profiler}, phase{phase}, start{profiler.isEnabled? Clock::now() : Clock::time_point{}} { }
+        ~ScopedTimer() {
+            if (!profiler.isEnabled) return;
+            profiler.current[phase] += std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+        }
+        ScopedTimer(const ScopedTimer&) = delete;
+    };
+
+    bool isEnabled {true};
+
+    [[nodiscard]] ScopedTimer Time(const Phase phase) { return {*this, phase}; }
+    // closes the current frame; pushing the accumulated timings into the history, and sampling the pool's busy-time
+    void EndFrame(ThreadPool* threadPool=nullptr);
+
+    float Latest (const Phase phase) const { return history[phase][(head + historyLength - 1) % historyLength]; }
+    float Average(const Phase phase) const;
+    float Max    (const Phase phase) const;
+    // ring-buffer; pass 'HistoryOffset()' as the 'values_offset' of ImGui::PlotLines/PlotHistogram
+    const float* History(const Phase phase) const { return history[phase].data(); }
+    int HistoryOffset() const { return head; }
+
+    float FrameTime() const { return frametime; } // ms between the last two EndFrame calls
+    // fraction of the frame each pool-thread spent executing tasks (smoothed); the calling thread is last
+    const std::vector<float>& ThreadUtilization() const { return utilization; }
+
+    private:
+    std::array<std::atomic<float>, PhaseCount> current{}; // written by the simulation-thread as well
+    std::array<std::array<float, historyLength>, PhaseCount> history{};
+    std::size_t head {0}; // next write-position in every history
+    std::size_t recorded {0};
+
+    Clock::time_point lastFrame {Clock::now()};
+    float frametime {0.f};
+    std::vector<double> busytime; // scratch-space for ThreadPool::CollectBusyTime
+    std::vector<float> utilization;
+};
+
+extern Profiler profiler; // Profiler.cpp
+
+
+#endif
@@ -1,380 +1,461 @@
 #include "Simulation.hpp"
 
-#include "Threading.hpp"
-
 #include <iostream>
 #include <tuple>
 #include <cassert>
+#include <algorithm> // max, sort
+#include <cmath> // fmod
+#include <chrono>
 
 
 #ifdef PMEMPTYCOUNTER
-long long pmemptycounter{0};  // counts how many times particleMap was empty
+long long pmemptycounter{0};  // counts how many times a cell was emptied by transitions
 #endif
 
-// helper function because sets don't have an inverse-merge
-std::size_t NegativeMerge(std::unordered_set<unsigned int>& source, const std::unordered_set<unsigned int>& toRemove)
-{
-    std::size_t numErased{0};
-    for (unsigned int thing: toRemove) {
-        source.erase(thing);
-        // if (source.erase(thing)) { ++numErased; }
-    }
-    return numErased;
-}
-
 
-bool Simulation::Initialize()
+bool Simulation::Initialize(const int columns, const int rows)
 {
     std::cout << "Initializing Simulation!\n";
     if (!diffusionField.Initialize()) { std::cerr << "diffusionField initialization failed!\n"; return false; }
-    if (!fluid.Initialize()) { std::cerr << "fluid initialization failed!\n"; return false; }
+    if (!fluid.Initialize(columns, rows)) { std::cerr << "fluid initialization failed!\n"; return false; }
     
     // finding/setting the initial cell for each Particle
-    for (Fluid::Particle& particle: fluid.particles)
+    ParticleState& particles = fluid.particles;
+    for (unsigned int ID{0}; ID < particles.size(); ++ID)
     {
-        const auto& [x, y] = particle.getPosition();
-        const unsigned int xi = x / SPATIAL_RESOLUTION;
-        const unsigned int yi = y / SPATIAL_RESOLUTION;
-        assert((xi <= Cell::maxIX) && (yi <= Cell::maxIY) && "out-of-bounds index");
-        Cell* cell = diffusionField.cellmatrix.at(xi).at(yi);
-        
-        particleMap[cell->UUID].emplace(particle.UUID);
-        particle.cellID = cell->UUID;
-        cell->density += 1.0;
+        const unsigned int cellID = Cell::UUIDAt(particles.x[ID], particles.y[ID]);
+        particles.cellID[ID] = cellID;
+        diffusionField.density[cellID] += 1.0;
     }
+    colouring.Build();
+    RebuildCellIndex();
     return true;
 }
 
-// note that the particles' cellID is NOT updated here
-TransitionList Simulation::FindCellTransitions() const
+// identifies Particles that have crossed a cell-boundary; appends to 'transitions' in ascending particle-order
+// note that the particles' cellID is NOT updated here (or the cells' density)
+void Simulation::FindCellTransitions(const std::size_t sliceStart, const std::size_t sliceEnd, TransitionList& transitions) const
 {
-    TransitionList transitions;
-    
-    for (const Fluid::Particle& particle: fluid.particles) {
-        const auto& oldcell = diffusionField.cells.at(particle.cellID);
-        if (oldcell.getGlobalBounds().contains(particle.getPosition())) continue;
-        else {
-            const auto& [x, y] = particle.getPosition();
-            const unsigned int xi = x / SPATIAL_RESOLUTION;
-            const unsigned int yi = y / SPATIAL_RESOLUTION;
-            assert((xi <= Cell::maxIX) && (yi <= Cell::maxIY) && "out-of-bounds index");
-            transitions.emplace_back(particle.UUID, particle.cellID, diffusionField.cellmatrix.at(xi).at(yi)->UUID);
+    const ParticleState& particles = fluid.particles;
+    // the current cell of a block of particles is computed first (branchless, so it vectorizes),
+    // then compared against the stored cellIDs; only the (few) mismatches are emitted
+    constexpr std::size_t blocksize {256};
+    std::array<unsigned int, blocksize> currentIDs;
+    
+    for (std::size_t blockStart{sliceStart}; blockStart < sliceEnd; blockStart += blocksize)
+    {
+        const std::size_t count = std::min(blocksize, sliceEnd - blockStart);
+        const float* xs = particles.x.data() + blockStart;
+        const float* ys = particles.y.data() + blockStart;
+        for (std::size_t index{0}; index < count; ++index) {
+            currentIDs[index] = Cell::UUIDAt(xs[index], ys[index]);
+        }
+        
+        const unsigned int* storedIDs = particles.cellID.data() + blockStart;
+        for (std::size_t index{0}; index < count; ++index) {
+            if (currentIDs[index] == storedIDs[index]) continue;
+            transitions.push_back({unsigned(blockStart + index), storedIDs[index], currentIDs[index]});
         }
     }
-    return transitions;
+    return;
+}
+
+
+// one flat TransitionList per slice; each slice is processed by exactly one task
+void Simulation::DetectTransitions()
+{
+    const std::size_t particlecount = fluid.particles.size();
+    const std::size_t slicecount = threadPool.Size() * 4;
+    const std::size_t grainsize = std::max<std::size_t>((particlecount + slicecount - 1) / slicecount, 1);
+    std::vector<TransitionList>& slices = transitionBuckets.slices;
+    slices.resize(slicecount);
+    for (TransitionList& slice: slices) { slice.clear(); } // trailing slices might not get a task
+    threadPool.ParallelFor(particlecount, grainsize, [this, &slices, grainsize](const std::size_t begin, const std::size_t end) {
+        FindCellTransitions(begin, end, slices[begin / grainsize]);
+    });
 }
 
-// multithreaded version
-DeltaMap Simulation::FindCellTransitions(const auto& particles_slice) const
+
+void TransitionBuckets::Sort(ThreadPool& pool, const std::size_t cellcount)
 {
-    DeltaMap dmap;
-    
-    for (auto iter{particles_slice.first}; iter < particles_slice.second; ++iter) {
-        const Fluid::Particle& particle = *iter;
-        const Cell& oldcell = diffusionField.cells.at(particle.cellID);
-        if (oldcell.getGlobalBounds().contains(particle.getPosition())) continue;
-        else {
-            const auto& [x, y] = particle.getPosition();
-            unsigned int xi = x / SPATIAL_RESOLUTION;
-            unsigned int yi = y / SPATIAL_RESOLUTION;
-            // TODO: actually fix this instead of workaround
-            if (xi > Cell::maxIX) xi = Cell::maxIX;
-            if (yi > Cell::maxIY) yi = Cell::maxIY;
-            assert((xi <= Cell::maxIX) && (yi <= Cell::maxIY) && "out-of-bounds index");
-            const Cell& newcell = *diffusionField.cellmatrix.at(xi).at(yi);
-            
-            dmap.transitionlist.emplace_back(particle.UUID, oldcell.UUID, newcell.UUID);
-            CellDelta_T& oldcell_delta = dmap.cellmap[oldcell.UUID];
-            CellDelta_T& newcell_delta = dmap.cellmap[newcell.UUID];
-            oldcell_delta.particlesRemoved.emplace(particle.UUID);
-            newcell_delta.particlesAdded.emplace(particle.UUID);
-            oldcell_delta.density -= 1.0f;
-            newcell_delta.density += 1.0f;
-            //oldcell_delta.velocities -= 1.0f;
-            newcell_delta.velocities += particle.velocity * momentumTransfer;
+    bucketcount = std::max<std::size_t>(slices.size(), 1);
+    cellsPerBucket = std::max<std::size_t>((cellcount + bucketcount - 1) / bucketcount, 1);
+    SortBy(pool, &Transition_T::newCellID, arrivals, arrivalStart);
+    SortBy(pool, &Transition_T::oldCellID, departures, departureStart);
+}
+
+
+// counting-sort by bucket; one pass to count, one to scatter (both parallel over the slices)
+void TransitionBuckets::SortBy(ThreadPool& pool, unsigned int Transition_T::* cellID, TransitionList& sorted, std::vector<std::size_t>& bucketStart)
+{
+    const std::size_t slicecount = slices.size();
+    offsets.assign(bucketcount * slicecount, 0);
+    // every task only touches the counters of it's own slice
+    pool.ParallelFor(slicecount, 1, [this, cellID, slicecount](const std::size_t begin, const std::size_t end) {
+        for (std::size_t slice{begin}; slice < end; ++slice) {
+            for (const Transition_T& transition: slices[slice]) { ++offsets[Bucket(transition.*cellID)*slicecount + slice]; }
+        }
+    });
+    
+    // exclusive scan; bucket-major, so every bucket is contiguous (with it's slices still in order)
+    bucketStart.resize(bucketcount + 1);
+    std::size_t total{0};
+    for (std::size_t bucket{0}; bucket < bucketcount; ++bucket) {
+        bucketStart[bucket] = total;
+        for (std::size_t slice{0}; slice < slicecount; ++slice) {
+            const std::size_t count = offsets[bucket*slicecount + slice];
+            offsets[bucket*slicecount + slice] = total;
+            total += count;
         }
     }
-    return dmap;
+    bucketStart[bucketcount] = total;
+    
+    sorted.resize(total);
+    pool.ParallelFor(slicecount, 1, [this, cellID, slicecount, &sorted](const std::size_t begin, const std::size_t end) {
+        for (std::size_t slice{begin}; slice < end; ++slice) {
+            for (const Transition_T& transition: slices[slice]) { sorted[offsets[Bucket(transition.*cellID)*slicecount + slice]++] = transition; }
+        }
+    });
+    return;
 }
 
 
-// note: cellmap gets eaten by the '.merge' call
-void Simulation::HandleTransitions(std::map<unsigned int, CellDelta_T>&& cellmap)
+// every bucket is handled by a single task, and no two buckets share a cell; so there's nothing to lock
+void Simulation::HandleTransitionBuckets()
 {
-    std::lock_guard<std::mutex> pmGuard(write_mutex);
-    constexpr float turbulence_offset = { 50.f / float(NUMROWS+NUMCOLUMNS)};
+    // drawn once for the whole step, before the buckets are handed out (normalizedRNG isn't thread-safe)
+    // scaled by the actual particle-layout (set at runtime; see SimulationConfig)
+    const float turbulence_offset = { 50.f / float(fluid.rows + fluid.columns)};
     const float rng = (turbulence_offset+normalizedRNG())*(turbulence_offset+normalizedRNG());
     
-    // required minimum cell-density before momentum transfers become active
-    constexpr float thresholdDensityMomentumTransfer {2.f};
+    threadPool.ParallelFor(transitionBuckets.bucketcount, 1, [this, rng](const std::size_t begin, const std::size_t end) {
+        for (std::size_t bucket{begin}; bucket < end; ++bucket) {
+            HandleTransitions(transitionBuckets.Arrivals(bucket), transitionBuckets.Departures(bucket), rng);
+        }
+    });
+    return;
+}
+
+
+// the bucket's transitions are grouped by cell here (they're usually only a handful, so a plain sort is fine);
+// the arrivals are sorted by particleID within each cell, so the momentum always accumulates in the same order
+void Simulation::HandleTransitions(std::span<Transition_T> arrivals, std::span<Transition_T> departures, const float rng)
+{
+    std::sort(arrivals.begin(), arrivals.end(), [](const Transition_T& lh, const Transition_T& rh) {
+        return (lh.newCellID != rh.newCellID)? (lh.newCellID < rh.newCellID) : (lh.particleID < rh.particleID);
+    });
+    std::sort(departures.begin(), departures.end(), [](const Transition_T& lh, const Transition_T& rh) {
+        return lh.oldCellID < rh.oldCellID;
+    });
     
-    // 'auto&&' is definitely correct here; ~100 FPS difference (300->400)
-    for (auto&& [cellID, delta]: cellmap)
+    // walking both lists together, one cell at a time
+    auto arrival = arrivals.begin();
+    auto departure = departures.begin();
+    while ((arrival != arrivals.end()) || (departure != departures.end()))
     {
-        Cell& cell = diffusionField.cells[cellID];
-        // delta.velocities has already been scaled by momentumTransfer
-        // updating densities
-        cell.density += delta.density;
-        
-        if (cell.density < thresholdDensityMomentumTransfer) { // skip the momentum-related code if cell is too empty
-            for (int particleID: delta.particlesAdded) {
-                fluid.particles[particleID].cellID = cellID;
-            }
-        } else {
-            // this should probably be reverted
-            // float smoothingdivisor = 1.0f + float(delta.particlesAdded.size() - delta.particlesRemoved.size());
-            float smoothingdivisor = float(delta.particlesAdded.size() + delta.particlesRemoved.size());
-            sf::Vector2f momentumSmoothing = { delta.velocities*momentumTransfer / smoothingdivisor };
-            if (fluid.isTurbulent) cell.momentum += momentumSmoothing * rng;
-            
-            // transferring momentum from new particles to cell
-            for (const int particleID: delta.particlesAdded)
-            {
-                Fluid::Particle& particle = fluid.particles.at(particleID);
-                if (fluid.isTurbulent) particle.velocity += momentumSmoothing * rng;
-                const sf::Vector2f momentumDelta = particle.velocity * momentumTransfer;
-                particle.velocity -= momentumDelta;
-                cell.momentum += momentumDelta;
-                //cell.momentum -= momentumSmoothing;
-                
-                //Cell& oldCell = diffusionField.cells[particle.cellID];
-                particle.cellID = cellID;
-            }
-        }
-        
-        /* if (fluid.isTurbulent) {
-            // applying momentumSmoothing to leaving particles
-            for (const int particleID: delta.particlesRemoved)
-            {
-                Fluid::Particle& particle = fluid.particles.at(particleID);
-                particle.velocity += momentumSmoothing * rng;
-                //cell.momentum -= momentumSmoothing*momentumDistribution;
-                //Cell& newCell = diffusionField.cells[cellID];
-            }
-        } */
-        
-        // transferring momentum to cell and updating particle's cellID
-        /* for (const int particleID: delta.particlesAdded) 
-        {
-            Fluid::Particle& particle = fluid.particles.at(particleID);
-            Cell& oldCell = diffusionField.cells[particle.cellID];
-            particle.cellID = cellID;
-            const sf::Vector2f momentumDelta = particle.velocity * momentumTransfer;
-            particle.velocity -= momentumDelta;
-            const sf::Vector2f momentumSmoothing = (oldCell.momentum-diffusionField.cells[cellID].momentum)*(momentumTransfer/2.0f);
-            oldCell.momentum -= momentumSmoothing;
-            diffusionField.cells[cellID].momentum += momentumDelta + momentumSmoothing;
-            // TODO: rewrite momentum calculations to account for density and viscosity
-            // and momentum should be applied/calculated every frame?
-        } */
-        
-        // updating particleMap
-        NegativeMerge(particleMap[cellID], delta.particlesRemoved);
-        particleMap[cellID].merge(delta.particlesAdded);
+        unsigned int cellID = (arrival != arrivals.end())? arrival->newCellID : departure->oldCellID;
+        if (departure != departures.end()) { cellID = std::min(cellID, departure->oldCellID); }
         
-        //if (fluid.isTurbulent) continue;
-        if (particleMap[cellID].empty()) {
-            #ifdef PMEMPTYCOUNTER
-            // turns out this happens a lot
-            pmemptycounter += 1;
-            #endif
-            
-            // disabling this prevents 'zipping' behind the mouse, and gives a minor performance improvement
-            //#define PRESERVE_EMPTYCELL_MOMENTUM
-            #ifndef PRESERVE_EMPTYCELL_MOMENTUM
-            diffusionField.cells[cellID].momentum = {0.0, 0.0};
-            particleMap.erase(cellID);
-            #else
-            // only erase if it's empty and has negligable momentum
-            // TODO: collect stats on this to find a good minimum
-            constexpr float small_enough = 0.001;
-            if ((abs(cell.momentum.x) < small_enough) 
-             && (abs(cell.momentum.y) < small_enough)) {
-                // TODO: defer this erase or something
-                diffusionField.cells[cellID].momentum = {0.0, 0.0};
-                particleMap.erase(cellID);
-                continue;
-             }
-             
-             // stored momentum would otherwise not decrease for empty cells
-            cell.momentum -= cell.momentum*momentumDistribution;
-            // we don't erase the cell because we want to keep decreasing the momentum
-            #endif
+        const auto arrivalsEnd = std::find_if(arrival, arrivals.end(), [cellID](const Transition_T& T) { return T.newCellID != cellID; });
+        const auto departuresEnd = std::find_if(departure, departures.end(), [cellID](const Transition_T& T) { return T.oldCellID != cellID; });
+        HandleCellTransitions(cellID, {arrival, arrivalsEnd}, std::size_t(departuresEnd - departure), rng);
+        arrival = arrivalsEnd;
+        departure = departuresEnd;
+    }
+    return;
+}
+
+
+// updates the cell's density, transfers momentum from the arriving particles, and sets their cellID.
+// only ever called by the task that owns the cell's bucket; the departed particles' old cells are handled by their own bucket
+void Simulation::HandleCellTransitions(const unsigned int cellID, std::span<const Transition_T> arrivals, const std::size_t departureCount, const float rng)
+{
+    // required minimum cell-density before momentum transfers become active
+    constexpr float thresholdDensityMomentumTransfer {2.f};
+    
+    ParticleState& particles = fluid.particles;
+    float& density = diffusionField.density[cellID];
+    density += float(int(arrivals.size()) - int(departureCount));
+    
+    if (density < thresholdDensityMomentumTransfer) { // skip the momentum-related code if cell is too empty
+        for (const Transition_T& transition: arrivals) {
+            particles.cellID[transition.particleID] = cellID;
         }
+        return;
     }
     
+    // velocities of the arriving particles (before any momentum is transferred)
+    sf::Vector2f velocities {0.0, 0.0};
+    for (const Transition_T& transition: arrivals) { velocities += particles.Velocity(transition.particleID) * momentumTransfer; }
+    
+    const float smoothingdivisor = float(arrivals.size() + departureCount);
+    const sf::Vector2f momentumSmoothing = { velocities*momentumTransfer / smoothingdivisor };
+    if (fluid.isTurbulent) diffusionField.AddMomentum(cellID, momentumSmoothing * rng);
+    
+    // transferring momentum from new particles to cell
+    for (const Transition_T& transition: arrivals)
+    {
+        const unsigned int particleID = transition.particleID;
+        if (fluid.isTurbulent) particles.AddVelocity(particleID, momentumSmoothing * rng);
+        const sf::Vector2f momentumDelta = particles.Velocity(particleID) * momentumTransfer;
+        particles.AddVelocity(particleID, -momentumDelta);
+        diffusionField.AddMomentum(cellID, momentumDelta);
+        particles.cellID[particleID] = cellID;
+    }
     return;
 }
 
 
-IDset_T Simulation::BuildAdjacentSet(const std::size_t cellID /*, const IDset_T& excluded */)
+// must be called after all transitions have been handled (particles' cellIDs are final)
+void Simulation::RebuildCellIndex()
 {
-    std::unordered_set<unsigned int> localParticles{};
-    const std::vector<Cell*> adjacentCells = diffusionField.GetCellNeighbors(cellID);
+    // one extra (always-empty) slot, for the GhostUUID
+    cellIndex.Rebuild(fluid.particles.cellID, diffusionField.cells.size()+1);
     
-    for (const auto* const cellptr: adjacentCells)
+    // clearing the stored momentum of cells that were emptied by the last transitions
+    // (an empty cell never distributes it's momentum, so it would otherwise persist)
+    std::vector<float>& momentumX = diffusionField.momentumX;
+    std::vector<float>& momentumY = diffusionField.momentumY;
+    for (unsigned int cellID{0}; cellID < momentumX.size(); ++cellID)
     {
-        // This check causes gaps/banding between sections (along the divisions between threads)
-            //if (particleMap.contains(cellptr->UUID) && !excluded.contains(cellptr->UUID))
-        // Inverting the second check causes pillars to appear instead
-            //if (excluded.contains(cellptr->UUID))
-        // Simply not checking the excluded set seems to be correct? I don't understand why
-            //if (particleMap.contains(cellptr->UUID))
-            //if (particleMap.contains(cellptr->UUID) || excluded.contains(cellptr->UUID)) // also seems to work, but probably incorrect
-        if (particleMap.contains(cellptr->UUID))
-        {
-            std::unordered_set<unsigned int> pmapCopy{particleMap[cellptr->UUID]};
-            
-            #define BUILDADJACENTSET_SIZECHECKS false
-            #if BUILDADJACENTSET_SIZECHECKS
-            if (particleMap[cellptr->UUID].size() == 0) { std::cerr << "empty set in particleMap!\n"; continue; }
-            std::size_t originalSize = pmapCopy.size();
-            std::size_t originalSizeLP = localParticles.size();
-            #endif
-            
-            //localParticles.merge(std::move(pmapCopy)); //doesn't seem to make a difference
-            localParticles.merge(pmapCopy);
-            
-            #if BUILDADJACENTSET_SIZECHECKS
-            std::size_t postmergeSize = pmapCopy.size();
-            std::size_t postmergeSizeLP = localParticles.size();
-            std::size_t diff = originalSize - postmergeSize;
-            std::size_t diffLP = postmergeSizeLP - originalSizeLP;
-            if (diff != diffLP) { 
-                std::cerr << "mismatched merge sizes!\n";
-                std::cerr << "pmapCopy: "       << originalSize   << " -> " << postmergeSize   << " = " << diff   << '\n';
-                std::cerr << "localParticles: " << originalSizeLP << " -> " << postmergeSizeLP << " = " << diffLP << '\n';
-            }
-            
-            assert((particleMap[cellptr->UUID].size() == originalSize) && "pmap did not actually copy");
-            #endif
+        if (!cellIndex.isEmpty(cellID)) continue;
+        if ((momentumX[cellID] == 0.f) && (momentumY[cellID] == 0.f)) continue;
+        #ifdef PMEMPTYCOUNTER
+        // turns out this happens a lot
+        pmemptycounter += 1;
+        #endif
+        
+        // disabling this prevents 'zipping' behind the mouse, and gives a minor performance improvement
+        //#define PRESERVE_EMPTYCELL_MOMENTUM
+        #ifndef PRESERVE_EMPTYCELL_MOMENTUM
+        momentumX[cellID] = 0.0f;
+        momentumY[cellID] = 0.0f;
+        #else
+        // only clear if it's empty and has negligable momentum
+        // TODO: collect stats on this to find a good minimum
+        constexpr float small_enough = 0.001;
+        if ((abs(momentumX[cellID]) < small_enough) 
+         && (abs(momentumY[cellID]) < small_enough)) {
+            momentumX[cellID] = 0.0f;
+            momentumY[cellID] = 0.0f;
+            continue;
+         }
+         
+         // stored momentum would otherwise not decrease for empty cells
+        momentumX[cellID] -= momentumX[cellID]*momentumDistribution;
+        momentumY[cellID] -= momentumY[cellID]*momentumDistribution;
+        #endif
+    }
+    return;
+}
+
+
+// walks the compile-time stencil of cells within DIFFUSION_RADIUS (orthogonal distance), instead of building a neighbor-list
+Simulation::NeighborSpans Simulation::QueryNeighbors(const std::size_t cellID) const
+{
+    NeighborSpans neighbors{};
+    const Cell& cell = diffusionField.cells[cellID];
+    const unsigned int* paddedCells = diffusionField.paddedCells.data() + diffusionField.PaddedIndex(cell.IX, cell.IY);
+    const std::array<int, Stencil<DIFFUSION_RADIUS>.size()>& paddedStencil = diffusionField.paddedStencil;
+    
+    // the origin isn't part of the stencil (it's handled by LocalDiffusion)
+    // out-of-bounds neighbors are the GhostUUID, which always has an empty span in the cellIndex
+    // (except in periodic-mode, where they're the cells on the opposite edge)
+    for (std::size_t index{0}; index < paddedStencil.size(); ++index)
+    {
+        const std::span<const unsigned int> particleSpan = cellIndex[paddedCells[paddedStencil[index]]];
+        if (particleSpan.empty()) continue;
+        sf::Vector2f shift {0.f, 0.f};
+        if (fluid.isPeriodic) {
+            const int X = int(cell.IX) + Stencil<DIFFUSION_RADIUS>[index].dx;
+            const int Y = int(cell.IY) + Stencil<DIFFUSION_RADIUS>[index].dy;
+            shift.x = (X < 0)? -config.PeriodicWidth()  : ((X >= int(Cell::maxIX))? config.PeriodicWidth()  : 0);
+            shift.y = (Y < 0)? -config.PeriodicHeight() : ((Y >= int(Cell::maxIY))? config.PeriodicHeight() : 0);
         }
+        neighbors.shifts[neighbors.count] = shift;
+        neighbors.spans[neighbors.count++] = particleSpan;
     }
     
-    return localParticles;
+    return neighbors;
 }
 
 
 // Diffusion between particles within a single cell (restricted because only the origin will excluded) 
 // otherwise, there will be many duplicate calculations between other cells, and everything will explode.
-void Simulation::LocalDiffusion(const IDset_T& particleset)
+void Simulation::LocalDiffusion(std::span<const unsigned int> particleset, VelocityBuffer& forces, PairBlock& block) const
 {
-    std::vector<sf::Vector2f> localForces;
-    localForces.resize(particleset.size(), {0,0});
+    block.clear();
+    block.Gather(fluid.particles, particleset);
+    const float scale = fluid.fdensity * timestepRatio;
     
     // calculating localForce between all particles in the cell
-    // nested loops avoid recalculating the force between every particle twice (by storing the negative)
-    std::vector<sf::Vector2f>::iterator iterVecTop{localForces.begin()};
-    for (auto iterTop{particleset.begin()}; iterTop != particleset.end(); ++iterTop)
+    // each particle only against the ones after it; avoids recalculating the force between every particle twice
+    // (the kernel stores the negative on the other particle)
+    for (std::size_t index{0}; index < block.size(); ++index)
     {
-        Fluid::Particle& particleTop = fluid.particles.at(*iterTop);
-        std::vector<sf::Vector2f>::iterator iterVecBottom{iterVecTop};
-        ++iterVecBottom;
-        
-        // notice the iteration in the loop condition (it can't be initialized with 'iterTop+1')
-        for (auto iterBottom{iterTop}; ++iterBottom != particleset.end();) {
-            const Fluid::Particle& particleBottom = fluid.particles.at(*iterBottom);
-            const sf::Vector2f localforce = Fluid::CalcLocalForce(particleTop, particleBottom, fluid.fdensity);
-            
-            *iterVecTop    += localforce;
-            *iterVecBottom -= localforce; // the other particle experiences forces in the opposite direction
-            
-            ++iterVecBottom;
-        }
-        
-        particleTop.velocity += *iterVecTop;
-        ++iterVecTop;
+        const std::size_t next = index+1;
+        const sf::Vector2f overlapForce = -fluid.particles.Velocity(block.IDs[index]) * scale;
+        const sf::Vector2f localforce = Fluid::AccumulatePairForces(block.x[index], block.y[index], overlapForce,
+            block.x.data()+next, block.y.data()+next, block.fx.data()+next, block.fy.data()+next, block.size()-next, scale);
+        block.fx[index] += localforce.x;
+        block.fy[index] += localforce.y;
     }
     
+    block.Scatter(forces);
     return;
 }
 
 // applies diffusion across cells. 
-void Simulation::NonLocalDiffusion(const IDset_T& originset, const IDset_T& adjacentset)
+void Simulation::NonLocalDiffusion(std::span<const unsigned int> originset, const NeighborSpans& neighbors, VelocityBuffer& forces, PairBlock& block) const
 {
-    if (adjacentset.empty()) { return; }
+    if (neighbors.empty()) { return; }
+    const ParticleState& particles = fluid.particles;
+    const float scale = fluid.fdensity * timestepRatio;
+    
+    // every adjacent particle gathered into one contiguous block
+    block.clear();
+    for (std::size_t index{0}; index < neighbors.count; ++index) {
+        block.Gather(particles, neighbors.spans[index], neighbors.shifts[index]);
+    }
+    
     for (const auto UUID : originset)
     {
-        Fluid::Particle& particle = fluid.particles.at(UUID);
-        for (const auto adjacentUUID: adjacentset)
-        {
-            Fluid::Particle& adjacentParticle = fluid.particles.at(adjacentUUID);
-            const sf::Vector2f localforce = Fluid::CalcLocalForce(particle, adjacentParticle, fluid.fdensity);
-            
-            particle.velocity += localforce;
-            adjacentParticle.velocity -= localforce; // the other particle experiences forces in the opposite direction
-            // not redundant because the originset will be excluded from the adjacentset later.
+        const sf::Vector2f overlapForce = -particles.Velocity(UUID) * scale;
+        const sf::Vector2f localforce = Fluid::AccumulatePairForces(particles.x[UUID], particles.y[UUID], overlapForce,
+            block.x.data(), block.y.data(), block.fx.data(), block.fy.data(), block.size(), scale);
+        forces.Add(UUID, localforce);
+    }
+    
+    block.Scatter(forces); // the other particles experience forces in the opposite direction
+    return;
+}
+
+
+void CellColouring::Build()
+{
+    // more than two blocks along an axis must be a multiple of three; otherwise the first and last block would share a colour
+    const auto BlockCount = [](const unsigned int cellcount) {
+        const unsigned int count = std::max(cellcount / blockWidth, 1u);
+        return ((count > 2)? count - (count % coloursPerAxis) : count);
+    };
+    const unsigned int blocksX = BlockCount(Cell::arraySizeX);
+    const unsigned int blocksY = BlockCount(Cell::arraySizeY);
+    
+    for (std::vector<unsigned int>& colour: blocks) { colour.clear(); }
+    for (unsigned int BX{0}; BX < blocksX; ++BX) {
+        for (unsigned int BY{0}; BY < blocksY; ++BY) {
+            blocks[(BX % coloursPerAxis)*coloursPerAxis + (BY % coloursPerAxis)].push_back(BX*blocksY + BY);
+        }
+    }
+    
+    // the leftover cells are spread over the blocks, so every block is still at least blockWidth wide
+    blockOf.resize(Cell::arraySizeX * Cell::arraySizeY);
+    for (unsigned int IX{0}; IX < Cell::arraySizeX; ++IX) {
+        for (unsigned int IY{0}; IY < Cell::arraySizeY; ++IY) {
+            blockOf[IX*Cell::arraySizeY + IY] = (IX*blocksX / Cell::arraySizeX)*blocksY + (IY*blocksY / Cell::arraySizeY);
         }
     }
+    cellStart.assign(blocksX*blocksY + 1, 0);
+    return;
+}
+
+
+// counting-sort of the occupied cells by their block
+void CellColouring::Sort(const std::vector<unsigned int>& occupied)
+{
+    std::ranges::fill(cellStart, 0);
+    for (const unsigned int cellID: occupied) { ++cellStart[blockOf[cellID] + 1]; }
+    for (std::size_t block{1}; block < cellStart.size(); ++block) { cellStart[block] += cellStart[block-1]; }
     
+    next.assign(cellStart.begin(), cellStart.end() - 1);
+    cells.resize(occupied.size());
+    for (const unsigned int cellID: occupied) { cells[next[blockOf[cellID]]++] = cellID; }
     return;
 }
 
 
 // assumes that density-updates were already performed on ALL cells (and momentum-calculations)
+// and that the cellIndex has been rebuilt since the last transitions
+// particle velocities are only read while the cells are processed; forces are accumulated into the velocityBuffer,
+// which is added to the ParticleState afterwards (ApplyVelocityBuffer).
+// every thread writes into the same buffer; the pair-forces are processed one colour of blocks at a time (see CellColouring),
+// so the results don't depend on the thread-count either
 void Simulation::UpdateParticles()
 {
-    // TODO: figure out how to share an 'excludedIDs' set between threads
-    auto segmented_particlemap = DivideContainer(particleMap);
-    auto lambda = [this](auto segment) 
+    velocityBuffer.resize(fluid.particles.size());
+    pairBlocks.resize(threadPool.Size());
+    
+    const std::vector<unsigned int>& occupied = cellIndex.OccupiedCells();
+    
+    // cell-level forces; the diffusionVec of every cell is calculated in one pass over the grid,
+    // then distributed (with the momentum) to the particles of the occupied cells
+    // (a seperate pass from the pair-forces, so that the profiler can time them independently)
+    // every particle belongs to exactly one cell, so this can be scheduled however
     {
-        // need to prevent redundant combinations when building the particleset for LocalDiffusion
-        //std::unordered_set<unsigned int> excludedIDs{};
-        
-        // only recalculate diffusionVec for occupied cells
-        for (auto iter{segment.first}; iter != segment.second; ++iter)
+        const auto timer = profiler.Time(Profiler::MomentumDistribution);
+        // densities changed with the last transitions (and the mouse)
+        diffusionField.CalcDiffusionField(threadPool, timestepRatio * fluid.fdensity);
+        threadPool.ParallelFor(occupied.size(), [this, &occupied](const std::size_t begin, const std::size_t end)
         {
-            auto& [cellID, particleset] = *iter;
-            // VERY IMPORTANT: particleset should NOT be a reference if you merge with it
-            //assert((particleset.size() > 0) && "empty particleset!");
-            if (particleset.empty()) { continue; }
-            
-            Cell& cell = diffusionField.cells.at(cellID);
-            cell.diffusionVec = diffusionField.CalcDiffusionVec(cellID) * timestepRatio * fluid.fdensity;
-            // TODO: repurpose diffusionVec to redistribute/smooth momentum between cells
-            
-            // fluid.ApplySpeedcap(cell.momentum);
-            const sf::Vector2f momentumDistributed = cell.momentum * momentumDistribution * timestepRatio;
-            const sf::Vector2f momentumPerParticle = momentumDistributed / float(particleset.size());
-            cell.momentum -= momentumDistributed;
-            
-            // distributing momentum and applying diffusionVec
-            for (unsigned int particleID: particleset) {
-                Fluid::Particle& particle = fluid.particles.at(particleID);
-                particle.velocity += cell.diffusionVec + momentumPerParticle;
+            for (std::size_t index{begin}; index < end; ++index)
+            {
+                const unsigned int cellID = occupied[index];
+                const std::span<const unsigned int> particleset = cellIndex[cellID];
+                assert((particleset.size() > 0) && "empty particleset!");
+                
+                const sf::Vector2f diffusionVec {diffusionField.diffusionX[cellID], diffusionField.diffusionY[cellID]};
+                
+                // fluid.ApplySpeedcap(momentum);
+                const sf::Vector2f momentumDistributed = diffusionField.Momentum(cellID) * momentumDistribution * timestepRatio;
+                const sf::Vector2f momentumPerParticle = momentumDistributed / float(particleset.size());
+                diffusionField.AddMomentum(cellID, -momentumDistributed);
+                
+                // distributing momentum and applying diffusionVec
+                for (unsigned int particleID: particleset) {
+                    velocityBuffer.Add(particleID, diffusionVec + momentumPerParticle);
+                }
+                // unfortunately, we have to handle diffusionVec and momentum in a seperate loop;
+                // because they're only meant to apply to the current cell's particles.
             }
-            // unfortunately, we have to handle diffusionVec and momentum in a seperate loop;
-            // because they're only meant to apply to the current cell's particles.
-            // that also means it must be done BEFORE merging the particlesets
-            
-            // TODO: split the cell-related updates into a seperate function?
-            
-            const std::size_t originalsize = particleset.size();
-            IDset_T nonlocalParticles = BuildAdjacentSet(cellID /* , excludedIDs */);
-            //particleset.merge(nonlocalParticles);  // the other merge order might be more effecient?
-            // VERY important that particleset isn't a reference here (if you merge); if it is, then every cell will end up-
-            // - holding duplicates of all the particles from each cell in it's diffusion-radius.
-            // then each cell will propagate their duplicates on every frame - segfault almost immediately.
-            
-            assert((particleMap[cellID].size() == originalsize) && "set in particleMap should not change size!!!!");
-            LocalDiffusion(particleset);
-            NonLocalDiffusion(particleset, nonlocalParticles);
-            //excludedIDs.emplace(cellID);
-        }
-    };
-    
-    std::array<std::future<void>, THREAD_COUNT> threads;
-    assert((segmented_particlemap.size() == threads.size()) && "mismatched sizes between particlemap and threads");
-    for (std::size_t index{0}; index < threads.size(); ++index) {
-        threads[index] = std::async(std::launch::async, lambda, segmented_particlemap[index]);
+        });
     }
-    for (auto& handle: threads) { handle.wait(); }
     
+    {
+        const auto timer = profiler.Time(Profiler::Diffusion);
+        colouring.Sort(occupied);
+        for (const std::vector<unsigned int>& blocks: colouring.blocks)
+        {
+            // one block per task; the blocks are much smaller than the grid, and their particle-counts vary
+            threadPool.ParallelFor(blocks.size(), 1, [this, &blocks](const std::size_t begin, const std::size_t end)
+            {
+                PairBlock& block = pairBlocks[ThreadPool::WorkerIndex()];
+                for (std::size_t index{begin}; index < end; ++index) {
+                    for (const unsigned int cellID: colouring.Cells(blocks[index])) {
+                        const std::span<const unsigned int> particleset = cellIndex[cellID];
+                        LocalDiffusion(particleset, velocityBuffer, block);
+                        NonLocalDiffusion(particleset, QueryNeighbors(cellID), velocityBuffer, block);
+                    }
+                }
+            });
+        }
+        
+        ApplyVelocityBuffer();
+    }
     return;
 }
 
 
-// cleaner and faster refactor, but not technically correct (physics are affected by timescale and FPS, race-conditions on momentum handling)
+// a single pass over the particles; the cost doesn't grow with the thread-count
+void Simulation::ApplyVelocityBuffer()
+{
+    threadPool.ParallelFor(fluid.particles.size(), [this](const std::size_t begin, const std::size_t end) {
+        velocityBuffer.ApplyAndClear(fluid.particles, begin, end);
+    });
+    return;
+}
+
+
+// cleaner and faster refactor, but not technically correct (physics are affected by timescale and FPS)
 void Simulation::Update_NewMethod()
 {
     if (isPaused) { return; }
@@ -387,29 +468,27 @@ void Simulation::Update_NewMethod()
         hasGravity, hasXGravity, fluid.gravity, fluid.xgravity, fluid.viscosity, fluid.bounceDampening, timestepRatio
     );
     
-    std::array<std::future<void>, THREAD_COUNT> threads;
-    for (std::size_t index{0}; auto&& slice: DivideContainer(fluid.particles)) {
-        threads[index] = std::async(std::launch::async, 
-        [this, gravityForces, viscosityMultiplier, bounceDampeningFactor] (auto&& sliced) { 
-            Fluid::UpdatePositions(sliced.first, sliced.second, gravityForces, viscosityMultiplier, bounceDampeningFactor);
-            HandleTransitions(FindCellTransitions(sliced).cellmap);
-            //UpdateParticles(sliced); // TODO: rewrite this to take a slice
-        }, slice);
-        ++index;
-    };
-    
-    bool isComplete{false};
-    do { isComplete = true;
-        for (const auto& future: threads) {
-            if(!future.valid()) { isComplete = false; continue; }
-            switch(future.wait_for(std::chrono::milliseconds(0))) // just checking the status
-            {
-                case std::future_status::ready: continue;
-                case std::future_status::timeout:
-                default: isComplete = false; break;
-            }
-        }
-    } while (!isComplete);
+    {
+        const auto timer = profiler.Time(Profiler::Integration);
+        threadPool.ParallelFor(fluid.particles.size(),
+        [this, gravityForces, viscosityMultiplier, bounceDampeningFactor] (const std::size_t begin, const std::size_t end) { 
+            Fluid::UpdatePositions(fluid.particles, begin, end, gravityForces, viscosityMultiplier, bounceDampeningFactor, fluid.isPeriodic);
+        });
+    }
+    // same partitioned transition-handling as the old method
+    {
+        const auto timer = profiler.Time(Profiler::TransitionDetection);
+        DetectTransitions();
+    }
+    {
+        const auto timer = profiler.Time(Profiler::TransitionSort);
+        transitionBuckets.Sort(threadPool, diffusionField.cells.size());
+    }
+    {
+        const auto timer = profiler.Time(Profiler::TransitionHandling);
+        HandleTransitionBuckets();
+        RebuildCellIndex();
+    }
     
     UpdateParticles();
     
@@ -422,35 +501,121 @@ void Simulation::Update_OldMethod()
 {
     if (isPaused) { return; }
     
-    std::array<std::future<DeltaMap>, THREAD_COUNT> threads;
-    auto particles_slices = DivideContainer(fluid.particles);
-    for (std::size_t index{0}; index < threads.size(); ++index) {
-        auto slice = particles_slices[index];
-        auto lambda = [this, slice](){ 
-            fluid.UpdatePositions(slice.first, slice.second, hasGravity, hasXGravity);
-            return FindCellTransitions(slice);
-        };
-        threads[index] = std::async(std::launch::async, lambda);
-    };
-    
-    DeltaMap transitions{};
-    for (auto& handle: threads) {
-        transitions.Combine(handle.get()); // extracts/moves elements with new keys
+    const std::size_t particlecount = fluid.particles.size();
+    {
+        const auto timer = profiler.Time(Profiler::Integration);
+        threadPool.ParallelFor(particlecount, [this](const std::size_t begin, const std::size_t end) {
+            fluid.UpdatePositions(begin, end, hasGravity, hasXGravity);
+        });
     }
     
-    // TODO: rewrite HandleTransitions to handle multithreading better
-    std::array<std::future<void>, THREAD_COUNT> transition_threads;
-    auto transition_slices = DivideContainer(transitions.cellmap);
-    for (std::size_t index{0}; index < transition_threads.size(); ++index) {
-        auto slice = transition_slices[index];
-        auto lambda = [this, slice]() { 
-            HandleTransitions({slice.first, slice.second});
-        };
-        transition_threads[index] = std::async(std::launch::async, lambda);
-    };
-    for (auto& handle: transition_threads) { handle.wait(); }
+    {
+        const auto timer = profiler.Time(Profiler::TransitionDetection);
+        DetectTransitions();
+    }
+    {
+        const auto timer = profiler.Time(Profiler::TransitionSort);
+        transitionBuckets.Sort(threadPool, diffusionField.cells.size());
+    }
+    {
+        // the result doesn't depend on the scheduling (or thread-count); so this is also the deterministic-mode
+        const auto timer = profiler.Time(Profiler::TransitionHandling);
+        HandleTransitionBuckets();
+        RebuildCellIndex();
+    }
     
     UpdateParticles();
     
     return;
 }
+
+
+// fixed-timestep accumulator; the frametime is simulated in whole substeps of 'fixedTimestep'.
+// the leftover fraction carries over to the next frame (and is used by RedrawFluid to interpolate between states)
+int Simulation::Advance(const float frameTimestep)
+{
+    if (!useFixedTimestep) { Update(); return 1; }
+    if (isPaused) { stepAccumulator = 0.0f; return 0; }
+    
+    stepAccumulator += frameTimestep;
+    const int substeps = std::min(int(stepAccumulator / fixedTimestep), maxSubsteps);
+    stepAccumulator -= substeps * fixedTimestep;
+    // couldn't keep up; dropping the excess instead of trying to catch up on the next frame
+    if (stepAccumulator >= fixedTimestep) { stepAccumulator = std::fmod(stepAccumulator, fixedTimestep); }
+    
+    for (int substep{0}; substep < substeps; ++substep)
+    {
+        if (substep == substeps-1) { fluid.SavePreviousPositions(); }
+        timestepRatio = fixedTimestep;
+        Update();
+    }
+    timestepRatio = frameTimestep; // everything outside the simulation (mouse, etc.) still sees the frametime
+    return substeps;
+}
+
+
+void Simulation::PublishSnapshot()
+{
+    StateSnapshot& snapshot = snapshots.Back();
+    const ParticleState& particles = fluid.particles;
+    // plain assignment reuses the back-buffer's capacity; nothing is allocated after the first few publishes
+    snapshot.particles.x  = particles.x;  snapshot.particles.y  = particles.y;
+    snapshot.particles.vx = particles.vx; snapshot.particles.vy = particles.vy;
+    snapshot.density = diffusionField.density;
+    snapshots.Publish();
+}
+
+
+void Simulation::StartThread()
+{
+    if (IsThreaded()) { return; }
+    PublishSnapshot(); // so the first frame has something to draw
+    snapshots.Acquire();
+    simulationThread = std::jthread([this](std::stop_token stopToken) { ThreadLoop(stopToken); });
+}
+
+
+void Simulation::StopThread()
+{
+    if (!IsThreaded()) { return; }
+    simulationThread.request_stop();
+    simulationThread.join();
+}
+
+
+// same fixed-timestep accumulator as the render-loop (Advance), but timed by the simulation-thread itself;
+// it sleeps until the next substep is due, so the simulation still runs in real-time.
+// in unthrottled-mode, every iteration is one whole step instead (as fast as the machine allows)
+void Simulation::ThreadLoop(std::stop_token stopToken)
+{
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point lastIteration = Clock::now();
+    while (!stopToken.stop_requested())
+    {
+        // copied while the lock is held; the render-thread might change them in between
+        float untilNextStep {0.0f}; // real-time (as a timestepRatio)
+        bool wasPaused {false};
+        {
+            const std::lock_guard<std::mutex> lock{stateMutex};
+            const Clock::time_point now = Clock::now();
+            const float elapsed = float(std::chrono::duration_cast<std::chrono::microseconds>(now - lastIteration).count() * 0.00006667);
+            lastIteration = now;
+            
+            if (runUnthrottled) { timestepRatio = fixedTimestep; Update(); }
+            else {
+                timestepRatio = elapsed * timestepMultiplier; // only used directly without useFixedTimestep
+                Advance(timestepRatio);
+                if (useFixedTimestep) { untilNextStep = (fixedTimestep - stepAccumulator) / timestepMultiplier; }
+            }
+            wasPaused = isPaused;
+            PublishSnapshot(); // every iteration; so that changes made while paused (mouse, Reset, etc.) still get drawn
+        }
+        
+        if (wasPaused) { std::this_thread::sleep_for(std::chrono::milliseconds(2)); }
+        else if (untilNextStep > 0.0f) { // capped, so that a tiny timescale can't delay a stop-request (or the mouse) for seconds
+            std::this_thread::sleep_for(std::chrono::microseconds(std::min(long(untilNextStep / 0.00006667f), 5000L)));
+        }
+        // the mutex isn't fair; without this, the render-thread might never get the lock back in unthrottled-mode
+        while (pendingLocks.load() > 0) { std::this_thread::yield(); }
+    }
+}
@@ -3,15 +3,21 @@
 
 #include "Diffusion.hpp"
 #include "Fluid.hpp"
+#include "CellIndex.hpp"
+#include "ThreadPool.hpp"
+#include "Profiler.hpp"
+#include "TripleBuffer.hpp"
 
-#include <unordered_set>
-#include <map>
-#include <thread> // std::mutex
+#include <thread> // std::mutex, jthread
+#include <stop_token>
+#include <atomic>
 #include <random>
+#include <cstdint>
+#include <algorithm> // clamp
 
 // holds info about a particle that has crossed into a new cell
 struct Transition_T {
-    const unsigned int particleID, oldCellID, newCellID; 
+    unsigned int particleID, oldCellID, newCellID; // not const; they get sorted (TransitionBuckets)
     /*bool operator==(const Transition_T& other) const {
         return particleID == other.particleID;
     };*/
@@ -28,62 +34,77 @@ struct Transition_T {
 };
 using TransitionList = std::vector<Transition_T>;
 
-using UUID_Map_T = std::map<unsigned int, std::unordered_set<unsigned int>>;
-using IDset_T = std::unordered_set<unsigned int>;
 
-struct CellDelta_T 
+// every transition of a step, grouped into buckets of cells.
+// detection fills a flat list per particle-slice, then a parallel counting-sort moves them into their buckets.
+// each bucket is a contiguous range of cells, so the buckets can be handled concurrently without any locking;
+// departures are sorted by their old cell, so the density-removals also stay within the bucket that owns the cell.
+// it's a member of the Simulation, so the arrays keep their capacity between steps
+struct TransitionBuckets
 {
-    //const unsigned int cellUUID;
-    IDset_T particlesAdded{};
-    IDset_T particlesRemoved{};
-    float density {0.0};
-    sf::Vector2f velocities {0.0, 0.0};
+    std::vector<TransitionList> slices; // per detection-slice; particleIDs ascending
+    TransitionList arrivals, departures; // every transition; grouped by the bucket of their newCellID / oldCellID
+    std::vector<std::size_t> arrivalStart, departureStart; // index of each bucket's first transition (bucketcount+1 entries)
+    std::vector<std::size_t> offsets; // counts, then write-positions during the sort; [bucket*slicecount + slice]
+    std::size_t bucketcount{1};
+    std::size_t cellsPerBucket{1};
+    
+    std::size_t Bucket(const unsigned int cellID) const { return cellID / cellsPerBucket; }
+    std::span<Transition_T> Arrivals  (const std::size_t bucket) { return {arrivals.data()   + arrivalStart[bucket],   arrivals.data()   + arrivalStart[bucket+1]};   }
+    std::span<Transition_T> Departures(const std::size_t bucket) { return {departures.data() + departureStart[bucket], departures.data() + departureStart[bucket+1]}; }
+    
+    // the slices are copied in order; so the particleIDs are still ascending within each bucket
+    void Sort(ThreadPool& pool, const std::size_t cellcount);
+    private:
+    void SortBy(ThreadPool& pool, unsigned int Transition_T::* cellID, TransitionList& sorted, std::vector<std::size_t>& bucketStart);
 };
 
 
-// TODO: replace DeltaMap_T with DeltaMap
-struct DeltaMap
+// Cells grouped into blocks of at least 'blockWidth' cells along each axis, coloured like a (3x3) checkerboard.
+// A cell's pair-forces only reach particles within DIFFUSION_RADIUS cells, and blocks of the same colour are two whole blocks apart;
+// so they never write to the same particles, and each colour can be processed in parallel (one block per task) into a single VelocityBuffer.
+// the block-counts are multiples of three (when there's more than two), so the colours still alternate across the periodic wrap
+struct CellColouring
 {
-    std::map<unsigned int, CellDelta_T> cellmap; // key is cellUUID
-    TransitionList transitionlist;
-    /* auto begin() { return cellmap.begin(); }
-    auto end()   { return cellmap.end();   } */
-    // loses info about transitionlist, but that's fine because it's unused
-    
-    DeltaMap() {}
-    /* DeltaMap(decltype(cellmap.begin()) B, decltype(cellmap.end()) E): cellmap(B, E) {} */
-    DeltaMap(DeltaMap&& other): cellmap{std::move(other.cellmap)}, transitionlist{other.transitionlist} {}
-    DeltaMap(TransitionList&& list) : transitionlist{list}
-    {
-        for (const auto& [particleID, oldCellID, newCellID]: list)
-        {
-            cellmap[newCellID].particlesAdded.emplace(particleID);
-            cellmap[oldCellID].particlesRemoved.emplace(particleID);
-        }
-        for (auto& [cellID, celldelta]: cellmap) {
-            celldelta.density = celldelta.particlesAdded.size() - celldelta.particlesRemoved.size();
-        }
-        // TODO: calculate and store momentumDelta here instead of HandleTransitions()
-    }
+    static constexpr unsigned int coloursPerAxis {3};
+    static constexpr unsigned int blockWidth {std::max(DIFFUSION_RADIUS, 1)}; // (coloursPerAxis-1)*blockWidth >= 2*DIFFUSION_RADIUS
+    std::array<std::vector<unsigned int>, coloursPerAxis*coloursPerAxis> blocks; // the blocks of each colour
+    std::vector<unsigned int> blockOf;   // block of each cell (by UUID)
+    std::vector<unsigned int> cellStart; // index of each block's first cell in 'cells' (blockcount+1 entries)
+    std::vector<unsigned int> cells;     // occupied cells, grouped by block (still ascending within each block)
+    std::vector<unsigned int> next;      // write-positions during the sort
+    
+    void Build(); // from the grid-size; called by Simulation::Initialize
+    void Sort(const std::vector<unsigned int>& occupied); // every step
+    std::span<const unsigned int> Cells(const std::size_t block) const { return {cells.data() + cellStart[block], cells.data() + cellStart[block+1]}; }
+};
+
+
+// copy of everything the renderer needs, published by the simulation-thread (see Simulation::StartThread)
+struct StateSnapshot
+{
+    ParticleState particles; // positions and velocities only; cellID is left empty
+    std::vector<float> density; // of each cell (indexed by UUID)
+};
+
+
+// counter-based generator (splitmix64 of the seed and an incrementing counter)
+// the entire state is two integers; reseeding restarts the exact same sequence
+struct CounterRNG
+{
+    using result_type = std::uint32_t; // matches std::random_device
+    std::uint64_t seed{0};
+    std::uint64_t counter{0};
     
-    void Combine(DeltaMap&& other)
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+    void Seed(const std::uint64_t newseed) { seed = newseed; counter = 0; }
+    result_type operator()()
     {
-        //this->transitionlist.insert(transitionlist.end(), other.transitionlist.begin(), other.transitionlist.end());
-        for (auto&& x : std::move(other.transitionlist)) {
-            transitionlist.emplace_back(x);
-        }
-        
-        // merge extracts/moves elements with new keys
-        this->cellmap.merge(other.cellmap);
-        // combine the remaining keys
-        for (auto&& [key, other_delta]: std::move(other.cellmap))
-        {
-            auto& entry = this->cellmap[key];
-            entry.particlesAdded.merge(other_delta.particlesAdded);
-            entry.particlesRemoved.merge(other_delta.particlesRemoved);
-            entry.density += other_delta.density;
-            entry.velocities += other_delta.velocities;
-        }
+        std::uint64_t z = seed + (++counter * 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return result_type((z ^ (z >> 31)) >> 32);
     }
 };
 
@@ -92,12 +113,16 @@ class Simulation
 {
     DiffusionField diffusionField{};
     Fluid fluid{};
-    UUID_Map_T particleMap{}; // mapping cellIDs to particleIDs
-    std::mutex write_mutex;
-    std::random_device RNG; // TODO: savestates
+    CellIndex cellIndex{}; // mapping cellIDs to particleIDs (rebuilt every step)
+    ThreadPool threadPool{}; // persistent workers shared by every update-phase (sized by hardware)
+    VelocityBuffer velocityBuffer; // forces accumulated by UpdateParticles; shared by every thread (see CellColouring)
+    CellColouring colouring;
+    std::vector<PairBlock> pairBlocks; // one per pool-thread; gathered positions for the pair-force kernel
+    CounterRNG RNG{std::random_device{}()}; // reseeded by SetDeterministic/Reset in deterministic-mode
+    float rngLast{0.0f};
     float normalizedRNG() {
-        static float last{0.0f};
-        float rng = RNG() / RNG.max();
+        float& last = rngLast;
+        float rng = RNG() / RNG.max(); // NOTE: integer division
         bool sign {rng > last};
         if(!sign) rng *= -last; // * -2?
         last += last*rng;
@@ -110,31 +135,106 @@ class Simulation
     bool useTransparency {false};  // slow-moving particles are more transparent
     bool isPaused{false};
     bool useOldmethod{true};  // changes 'Update' method
+    
+    // deterministic-mode: identical inputs produce bit-identical particle-states
+    // (fixed timestep, seeded RNG, static thread-scheduling, and transitions handled in a fixed order)
+    bool isDeterministic{false};
+    std::uint64_t deterministicSeed{0};
+    float deterministicTimestep{1.0f}; // overrides the frametime-based timestepRatio
+    
+    // fixed-timestep mode (Advance): the frametime accumulates, and the simulation runs whole substeps of 'fixedTimestep',
+    // so the physics no longer depend on the framerate. at most 'maxSubsteps' per frame; time beyond that is dropped
+    // (otherwise a machine that can't keep up falls further behind every frame; the 'spiral of death')
+    bool useFixedTimestep{true};
+    float fixedTimestep{1.0f}; // timestepRatio of every substep (1.0 is 15ms of real-time)
+    int maxSubsteps{4};
+    float stepAccumulator{0.0f}; // real-time (as a timestepRatio) not yet simulated
     friend int main(int argc, char** argv); // only so that the turbulence render block can check 'isPaused'
     
+    // threaded-mode (StartThread): the simulation steps on it's own thread, paced by it's own clock,
+    // and the render-loop only draws the latest published snapshot; so neither can stall the other.
+    // anything else on the render-thread that touches the simulation-state (events, keybinds, the GUI) must hold LockState()
+    std::mutex stateMutex; // held by the simulation-thread for each step
+    std::atomic<int> pendingLocks{0}; // render-thread waiting on the stateMutex; the simulation-thread yields to it between steps
+    TripleBuffer<StateSnapshot> snapshots;
+    bool runUnthrottled{false}; // threaded-mode: steps back-to-back (one fixedTimestep each) instead of in real-time
+    void PublishSnapshot(); // copies the current state into the back-buffer; simulation-thread (or with the stateMutex held)
+    void ThreadLoop(std::stop_token stopToken);
+    
     // TODO: scale these based on density
     float momentumTransfer{0.375}; // percentage of velocity transferred to cell (and lost) by particle
     float momentumDistribution{0.25}; // percentage of cell's total momentum distributed to local particles per timestep
     
-    // identifies Particles that have crossed a cell-boundary
-    // does NOT update the Particles' cellID or the cells' density
-    TransitionList FindCellTransitions() const;
-    DeltaMap FindCellTransitions(const auto& particles_slice) const; // multithreaded version
-    void HandleTransitions(std::map<unsigned int, CellDelta_T>&& cellmap); // cellmap-parameter gets eaten by this function (invalidated)
+    // transitions are detected into the per-slice lists, sorted into buckets, then each bucket is handled by one task.
+    // cells (and the cellIDs of the particles arriving in them) are partitioned between the buckets, so nothing is locked;
+    // a departure only affects the density of it's old cell, so those are sorted into the old cell's bucket instead
+    TransitionBuckets transitionBuckets;
+    // identifies Particles that have crossed a cell-boundary; does NOT update the Particles' cellID or the cells' density
+    void FindCellTransitions(const std::size_t sliceStart, const std::size_t sliceEnd, TransitionList& transitions) const;
+    void DetectTransitions(); // fills transitionBuckets.slices
+    void HandleTransitionBuckets(); // call transitionBuckets.Sort first
+    // all transitions into/out of a single bucket; every cell (and every arriving particle) only belongs to one bucket
+    void HandleTransitions(std::span<Transition_T> arrivals, std::span<Transition_T> departures, const float rng);
+    void HandleCellTransitions(const unsigned int cellID, std::span<const Transition_T> arrivals, const std::size_t departureCount, const float rng);
     void UpdateParticles();
-    void LocalDiffusion(const IDset_T& particleset); // diffusion within a single cell
-    void NonLocalDiffusion(const IDset_T& originset, const IDset_T& adjacentset); // diffusion across cells
-    IDset_T BuildAdjacentSet(const std::size_t cellID /* , const IDset_T& excluded */);
+    void ApplyVelocityBuffer(); // adds the accumulated forces to the particles' velocities (and clears them)
+    void RebuildCellIndex(); // also clears the momentum of emptied cells
+    
+    // particles of every occupied cell within DIFFUSION_RADIUS of a cell (excluding the cell itself).
+    // just views into the cellIndex; nothing gets copied or allocated
+    // in periodic-mode, cells across the edge have a shift (minimum-image) added to their particles' positions
+    struct NeighborSpans {
+        std::array<std::span<const unsigned int>, LocalCells<DIFFUSION_RADIUS>::BasecountTotal()> spans;
+        std::array<sf::Vector2f, LocalCells<DIFFUSION_RADIUS>::BasecountTotal()> shifts;
+        std::size_t count{0};
+        auto begin() const { return spans.begin(); }
+        auto end()   const { return spans.begin() + count; }
+        bool empty() const { return (count == 0); }
+    };
+    NeighborSpans QueryNeighbors(const std::size_t cellID) const;
+    
+    // both only read the ParticleState; forces are accumulated into the calling thread's buffer
+    // (the PairBlock is per-thread scratch-space for the batched pair-force kernel)
+    void LocalDiffusion(std::span<const unsigned int> particleset, VelocityBuffer& forces, PairBlock& block) const; // diffusion within a single cell
+    void NonLocalDiffusion(std::span<const unsigned int> originset, const NeighborSpans& neighbors, VelocityBuffer& forces, PairBlock& block) const; // diffusion across cells
     void Update_NewMethod(); // faster but does not timescale properly
     void Update_OldMethod(); // better in general (especially for turbulence-mode), but slow
     
     friend class MainGUI;
     friend struct SimulParameters; // MainGUI
+    friend class HeadlessRunner; // Headless.cpp
+    friend class Benchmark; // Benchmark.cpp
     
     public:
-    bool Initialize();
-    void Update() { if(useOldmethod) Update_OldMethod(); else Update_NewMethod(); return; }
+    bool Initialize(const int columns=config.columns, const int rows=config.rows); // layout (and number) of particles
+    void Update() {
+        if (isDeterministic) { timestepRatio = deterministicTimestep; }
+        // deterministic-mode always uses the old method; so the results don't depend on the toggle
+        if (useOldmethod || isDeterministic) Update_OldMethod(); else Update_NewMethod();
+        return;
+    }
     void Step(); // TODO: implement this
+    // called once per frame by the render-loop, with the frame's (variable) timestepRatio; returns the number of substeps.
+    // without useFixedTimestep, it's just one Update of the whole frametime
+    int Advance(const float frameTimestep);
+    // how far the render should be between the last two states; the remainder of the accumulator (in substeps)
+    float InterpolationAlpha() const {
+        if (!useFixedTimestep || isPaused) { return 1.0f; }
+        return std::clamp(stepAccumulator / fixedTimestep, 0.0f, 1.0f);
+    }
+    
+    // the render-loop stops calling Advance; it just calls AcquireSnapshot once per frame (lock-free)
+    void StartThread();
+    void StopThread();
+    bool IsThreaded() const { return simulationThread.joinable(); }
+    void AcquireSnapshot() { snapshots.Acquire(); }
+    // without the simulation-thread, it's just an uncontended lock
+    [[nodiscard]] std::unique_lock<std::mutex> LockState() {
+        ++pendingLocks;
+        std::unique_lock<std::mutex> lock{stateMutex};
+        --pendingLocks;
+        return lock;
+    }
     
     // mouse needs to access this pointer to lookup cell (given an X/Y coord)
     DiffusionField* GetDiffusionFieldPtr() { return &diffusionField; }  //TODO: get rid of this
@@ -156,6 +256,17 @@ class Simulation
         return fluid.isTurbulent; 
     }
     bool ToggleUpdateMethod() { useOldmethod = !useOldmethod; return useOldmethod; }
+    // the density-grid's ghost-cells; periodic also makes the particles wrap around
+    void SetBoundary(const DiffusionField::Boundary boundary) {
+        diffusionField.SetBoundary(boundary);
+        fluid.isPeriodic = (boundary == DiffusionField::Boundary::Periodic);
+    }
+    void SetDeterministic(const bool enable, const std::uint64_t seed=0) {
+        isDeterministic = enable;
+        deterministicSeed = seed;
+        threadPool.SetStaticSchedule(enable);
+        if (enable) { RNG.Seed(seed); rngLast = 0.0f; }
+    }
     
     void Freeze() // sets all velocities to 0
     {
@@ -167,31 +278,46 @@ class Simulation
     
     void Reset()
     {
-        particleMap.clear();
         diffusionField.Reset();
         fluid.Reset(); // resets positions! (required for next loop)
-        for (Fluid::Particle& particle: fluid.particles)
+        if (isDeterministic) { RNG.Seed(deterministicSeed); rngLast = 0.0f; }
+        ParticleState& particles = fluid.particles;
+        for (unsigned int ID{0}; ID < particles.size(); ++ID)
         {
-            const auto& [x, y] = particle.getPosition();
-            const unsigned int xi = x / SPATIAL_RESOLUTION;
-            const unsigned int yi = y / SPATIAL_RESOLUTION;
-            Cell* cell = diffusionField.cellmatrix.at(xi).at(yi);
-            
-            particleMap[cell->UUID].emplace(particle.UUID);
-            particle.cellID = cell->UUID;
-            cell->density += 1.0;
+            const unsigned int cellID = Cell::UUIDAt(particles.x[ID], particles.y[ID]);
+            particles.cellID[ID] = cellID;
+            diffusionField.density[cellID] += 1.0;
         }
+        RebuildCellIndex();
+        #ifndef FLUIDSIM_HEADLESS
         RedrawGrid();
         RedrawFluid(true);
+        #endif
         return;
     }
     
-    void RedrawGrid()  { diffusionField.Redraw(); }
-    void RedrawFluid(const bool shouldClear) { fluid.Redraw(useTransparency, shouldClear); }
+    #ifndef FLUIDSIM_HEADLESS
+    // threaded-mode draws the snapshot (already the latest state, so there's nothing to interpolate)
+    void RedrawGrid() {
+        const auto timer = profiler.Time(Profiler::GridRedraw);
+        if (IsThreaded()) diffusionField.Redraw(snapshots.Front().density);
+        else diffusionField.Redraw();
+    }
+    void RedrawFluid(const bool shouldClear) {
+        const auto timer = profiler.Time(Profiler::FluidRedraw);
+        if (IsThreaded()) fluid.Redraw(snapshots.Front().particles, useTransparency, shouldClear);
+        else fluid.Redraw(useTransparency, shouldClear, InterpolationAlpha());
+    }
     auto GetSprites() { 
         struct Sprites{sf::Sprite gridSprite; sf::Sprite fluidSprite;};
         return Sprites{diffusionField.GetSprite(), fluid.GetSprite()};
     }
+    #endif
+    
+    ~Simulation() { StopThread(); } // before any of the members it's using are destroyed
+    
+    private:
+    std::jthread simulationThread;
 };
 
 //#define PMEMPTYCOUNTER
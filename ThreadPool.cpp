@@ -0,0 +1,168 @@
+#include "ThreadPool.hpp"
+#include "Threading.hpp" // ThreadManager
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+
+thread_local unsigned int ThreadPool::workerIndex{0};
+
+
+ThreadPool::ThreadPool(unsigned int threadcount)
+{
+    if (threadcount == 0) { threadcount = ThreadManager{}.GetThreadCount(); }
+    Start(threadcount);
+}
+
+
+void ThreadPool::Start(const unsigned int threadcount)
+{
+    assert(workers.empty() && "ThreadPool was already started");
+    const unsigned int workercount = std::max(threadcount, 1u) - 1;
+    isStopping = false;
+
+    queues.clear();
+    for (unsigned int index{0}; index <= workercount; ++index) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    workers.reserve(workercount);
+    for (unsigned int index{0}; index < workercount; ++index) {
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, index);
+    }
+    return;
+}
+
+
+void ThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleep_mutex);
+        isStopping = true;
+    }
+    wakeup.notify_all();
+    for (std::thread& worker: workers) { worker.join(); }
+    workers.clear();
+    return;
+}
+
+
+void ThreadPool::RunTask(const Task& task, const std::size_t self)
+{
+    const auto start = std::chrono::steady_clock::now();
+    (*task.body)(task.begin, task.end);
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    queues[self]->busyNs.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+    task.remaining->fetch_sub(1, std::memory_order_release);
+}
+
+
+void ThreadPool::CollectBusyTime(std::vector<double>& busyMs)
+{
+    busyMs.resize(queues.size());
+    for (std::size_t index{0}; index < queues.size(); ++index) {
+        busyMs[index] = double(queues[index]->busyNs.exchange(0, std::memory_order_relaxed)) / 1e6;
+    }
+    return;
+}
+
+
+// checks own queue first, then tries to steal from every other queue
+bool ThreadPool::PopTask(const std::size_t self, Task& task)
+{
+    {
+        WorkQueue& own = *queues[self];
+        std::lock_guard<std::mutex> guard(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            own.pending.fetch_sub(1, std::memory_order_relaxed);
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    if (isStaticSchedule.load(std::memory_order_relaxed)) { return false; }
+    for (std::size_t offset{1}; offset < queues.size(); ++offset)
+    {
+        WorkQueue& victim = *queues[(self + offset) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            victim.pending.fetch_sub(1, std::memory_order_relaxed);
+            queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void ThreadPool::WorkerLoop(const unsigned int index)
+{
+    workerIndex = index;
+    Task task;
+    while (true)
+    {
+        if (PopTask(index, task)) { RunTask(task, index); continue; }
+
+        // without stealing, the remaining tasks may all belong to other threads; only the own queue counts
+        const WorkQueue& own = *queues[index];
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        wakeup.wait(lock, [this, &own]{
+            if (isStopping) { return true; }
+            if (isStaticSchedule.load(std::memory_order_relaxed)) { return (own.pending.load(std::memory_order_relaxed) > 0); }
+            return (queuedTasks.load(std::memory_order_relaxed) > 0);
+        });
+        if (isStopping) { return; }
+    }
+}
+
+
+void ThreadPool::ParallelFor(const std::size_t count, std::size_t grainsize, const RangeFunc& body)
+{
+    if (count == 0) { return; }
+    grainsize = std::max<std::size_t>(grainsize, 1);
+    const std::size_t chunkcount = (count + grainsize - 1) / grainsize;
+    const std::size_t callerSlot = workers.size();
+    // restored on return; the calling thread only owns the slot for this call
+    struct SlotGuard {
+        const unsigned int previous {workerIndex};
+        ~SlotGuard() { workerIndex = previous; }
+    } slotGuard;
+    workerIndex = callerSlot;
+
+    if (workers.empty() || (chunkcount == 1)) {
+        std::atomic<std::size_t> remaining{1};
+        RunTask(Task{&body, 0, count, &remaining}, callerSlot);
+        return;
+    }
+
+    // each queue gets a contiguous block of chunks (better locality than round-robin)
+    std::atomic<std::size_t> remaining{chunkcount};
+    for (std::size_t chunk{0}; chunk < chunkcount; ++chunk)
+    {
+        const std::size_t begin = chunk * grainsize;
+        const std::size_t end   = std::min(begin + grainsize, count);
+        WorkQueue& queue = *queues[(chunk * queues.size()) / chunkcount];
+        std::lock_guard<std::mutex> guard(queue.mutex);
+        queue.tasks.push_back(Task{&body, begin, end, &remaining});
+        queue.pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    {
+        // incremented under the sleep-mutex so that a worker can't miss the wakeup
+        // (the per-queue counts are published by the same lock)
+        std::lock_guard<std::mutex> guard(sleep_mutex);
+        queuedTasks.fetch_add(chunkcount, std::memory_order_relaxed);
+    }
+    wakeup.notify_all();
+
+    // the calling thread helps out until every chunk is finished (including chunks stolen by workers)
+    Task task;
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (PopTask(callerSlot, task)) { RunTask(task, callerSlot); }
+        else { std::this_thread::yield(); }
+    }
+    return;
+}
@@ -0,0 +1,88 @@
+#ifndef FLUIDSIM_THREADPOOL_INCLUDED
+#define FLUIDSIM_THREADPOOL_INCLUDED
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <memory> // unique_ptr
+#include <cstdint>
+
+
+// Persistent pool of worker-threads with per-worker work-stealing queues.
+// Replaces spawning fresh std::async tasks for every phase of every frame.
+// The thread calling 'ParallelFor' also executes tasks, so a pool of size N only spawns N-1 workers.
+// (kept out of Threading.hpp because that header's generic 'operator+' would leak into every includer)
+class ThreadPool
+{
+    public:
+    using RangeFunc = std::function<void(std::size_t, std::size_t)>; // [begin, end)
+
+    private:
+    struct Task {
+        const RangeFunc* body {nullptr};
+        std::size_t begin {0}, end {0};
+        std::atomic<std::size_t>* remaining {nullptr}; // counts down chunks of the owning ParallelFor
+    };
+
+    // owner pops from the front, thieves steal from the back
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<std::size_t> pending {0}; // tasks.size(); static-scheduled workers sleep until their own queue has work
+        std::atomic<std::uint64_t> busyNs {0}; // time the owning thread spent executing tasks (for the Profiler)
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues; // one per worker, plus one for the calling thread (last)
+    std::mutex sleep_mutex;
+    std::condition_variable wakeup;
+    std::atomic<std::size_t> queuedTasks {0};
+    bool isStopping {false};
+    std::atomic<bool> isStaticSchedule {false}; // disables stealing
+
+    static thread_local unsigned int workerIndex;
+
+    void Start(const unsigned int threadcount);
+    void Stop();
+    void WorkerLoop(const unsigned int index);
+    bool PopTask(const std::size_t self, Task& task);
+    void RunTask(const Task& task, const std::size_t self);
+
+    public:
+    // threadcount includes the calling thread; defaults to the count reported by hardware (ThreadManager)
+    explicit ThreadPool(unsigned int threadcount = 0);
+    ~ThreadPool() { Stop(); }
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void Resize(const unsigned int threadcount) { Stop(); Start(threadcount); }
+    unsigned int Size() const { return workers.size() + 1; } // total number of threads executing tasks
+    
+    // static-scheduling: every chunk is executed by the thread it was assigned to (no stealing)
+    // so that the chunk->WorkerIndex mapping (and per-thread accumulation) is reproducible
+    void SetStaticSchedule(const bool enable) { isStaticSchedule.store(enable); }
+
+    // index of the executing thread within this pool; [0, Size()). The calling thread is always 'Size()-1'
+    // intended for indexing per-thread buffers from inside a ParallelFor body
+    static unsigned int WorkerIndex() { return workerIndex; }
+
+    // busy-time (ms) of every thread since the last call, indexed by WorkerIndex; resets the counters
+    void CollectBusyTime(std::vector<double>& busyMs);
+
+    // splits [0, count) into chunks of 'grainsize' and blocks until every chunk has been processed.
+    // the calling thread takes the last slot for the duration, so only one thread may call it at a time,
+    // and never from inside a body (a nested call would share that slot with the outer caller)
+    void ParallelFor(const std::size_t count, std::size_t grainsize, const RangeFunc& body);
+    // picks a grainsize that gives each thread a few chunks to balance/steal
+    void ParallelFor(const std::size_t count, const RangeFunc& body) {
+        const std::size_t chunkcount = Size() * 4;
+        ParallelFor(count, (count + chunkcount - 1) / chunkcount, body);
+    }
+};
+
+
+#endif
@@ -20,7 +20,8 @@ class ThreadManager
     void PrintThreadcount();
     void ContainerDivTest(); // iterates over the result of DivideContainer
     void ContainerDivTestMT();
-    
+    unsigned int GetThreadCount() const { return ((THREAD_COUNT > 0)? THREAD_COUNT : 1); } // hardware_concurrency may return 0
+
     ThreadManager(): THREAD_COUNT{std::thread::hardware_concurrency()}
     {
         
@@ -0,0 +1,38 @@
+#ifndef FLUIDSIM_TRIPLEBUFFER_HPP_INCLUDED
+#define FLUIDSIM_TRIPLEBUFFER_HPP_INCLUDED
+
+#include <array>
+#include <atomic>
+
+
+// Lock-free handoff of the latest state from one writer-thread to one reader-thread.
+// The writer fills 'Back()' and publishes it; the reader takes whatever was published most recently.
+// Neither side ever waits on the other: the writer never blocks on a slow reader (it just overwrites
+// the unread state), and the reader keeps drawing it's current buffer until a newer one is published.
+// The buffers are never reallocated or copied between, so vectors inside them keep their capacity.
+template <typename T>
+class TripleBuffer
+{
+    std::array<T, 3> buffers{};
+    // index of the buffer between the writer and reader; 'freshBit' marks that it was published but not yet taken
+    static constexpr unsigned int freshBit {0b100};
+    std::atomic<unsigned int> middle {1};
+    unsigned int back  {0}; // only touched by the writer
+    unsigned int front {2}; // only touched by the reader
+
+    public:
+    // writer-side
+    T& Back() { return buffers[back]; }
+    void Publish() { back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & ~freshBit; }
+
+    // reader-side; returns false (and keeps the current front) if nothing new was published
+    bool Acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & freshBit)) { return false; }
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~freshBit;
+        return true;
+    }
+    const T& Front() const { return buffers[front]; }
+};
+
+
+#endif